@@ -70,14 +70,20 @@ typedef struct _Choices {
 
 static ChoicePtr choices;
 
-time_t
-disposeIndirectHosts()
+/* the list is sorted by timeout, so only the head needs a timer */
+static void disposeIndirectHosts(void *arg);
+static Timer choiceTimer = { 0, 0, 0, disposeIndirectHosts, 0, 0 };
+
+static void
+disposeIndirectHosts(void *arg ATTR_UNUSED)
 {
     ChoicePtr c;
 
     while (choices) {
-        if (choices->timeout > now)
-            return choices->timeout;
+        if (choices->timeout > now) {
+            armTimer(&choiceTimer, choices->timeout);
+            return;
+        }
         debug("timing out indirect host\n");
         c = choices;
         choices = c->next;
@@ -86,7 +92,6 @@ disposeIndirectHosts()
         XdmcpDisposeARRAY8(&c->choice);
         free(c);
     }
-    return TO_INF;
 }
 
 ARRAY8Ptr
@@ -184,30 +189,58 @@ registerIndirectChoice(ARRAY8Ptr clientAddress, ARRAY8Ptr clientPort,
     c->timeout = now + choiceTimeout;
     c->next = 0;
     *cp = c;
+    if (!timerPending(&choiceTimer))
+        armTimer(&choiceTimer, choices->timeout);
 }
 
 
 /* ####################### */
 
 
+/*
+ * Pinging: every address gets up to PING_TRIES queries, the pauses
+ * between them doubling from PING_INTERVAL on. Unicast addresses are
+ * not bothered any more once they answered. The total packet rate is
+ * limited to PING_RATE per second (with bursts of PING_BURST), so
+ * large lists of hosts do not flood the network.
+ */
+#define PING_TRIES 3
+#define PING_INTERVAL 500 /* msecs */
+#define PING_RATE 200
+#define PING_BURST 20
+
+/* Changes to the host list are sent to the greeter this often at most. */
+#define FLUSH_INTERVAL 100 /* msecs */
+
+#define HOST_HASH_SIZE 256
+
 typedef struct _HostAddr {
-    struct _HostAddr *next;
+    struct _HostAddr *next, *hnext;
     struct sockaddr *addr;
     int addrlen;
     xdmOpCode type;
+    int tries;                  /* pings sent in this round */
+    unsigned long due;          /* time of next ping or end of round */
 } HostAddr;
 
-static HostAddr *hostAddrdb;
+static HostAddr *hostAddrdb, *hostAddrHash[HOST_HASH_SIZE];
+static int broadcastRegistered;
 
 typedef struct _HostName {
-    struct _HostName *next;
-    unsigned willing:1, alive:1;
+    struct _HostName *next, *hnext;
+    unsigned willing:1, alive:1, dirty:2;
     ARRAY8 hostname, status;
     CARD16 connectionType;
     ARRAY8 hostaddr;
 } HostName;
 
-static HostName *hostNamedb;
+#define HN_CLEAN 0
+#define HN_ADDED 1
+#define HN_CHANGED 2
+
+static HostName *hostNamedb, *hostNameHash[HOST_HASH_SIZE];
+static int dirtyHosts;
+static unsigned long dirtySince;
 
 static XdmcpBuffer directBuffer, broadcastBuffer;
 static XdmcpBuffer buffer;
@@ -218,28 +251,183 @@ static int socket6FD;
 #endif
 
 
+static unsigned
+hashBytes(const CARD8 *data, int len)
+{
+    unsigned h = 0;
+
+    while (len--)
+        h = h * 31 + *data++;
+    return h % HOST_HASH_SIZE;
+}
+
+/* the hash key of a socket address does not include the port */
+static unsigned
+hashSockAddr(struct sockaddr *addr)
+{
+    switch (addr->sa_family) {
+    case AF_INET:
+        return hashBytes((CARD8 *)&((struct sockaddr_in *)addr)->sin_addr, 4);
+#if defined(IPv6) && defined(AF_INET6)
+    case AF_INET6:
+        return hashBytes((CARD8 *)&((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+#endif
+    default:
+        return 0;
+    }
+}
+
+static int
+sockAddrEqual(struct sockaddr *a1, struct sockaddr *a2, int withPort)
+{
+    if (a1->sa_family != a2->sa_family)
+        return False;
+    switch (a1->sa_family) {
+    case AF_INET: {
+        struct sockaddr_in *na = (struct sockaddr_in *)a1;
+        struct sockaddr_in *oa = (struct sockaddr_in *)a2;
+        return (!withPort || na->sin_port == oa->sin_port) &&
+               na->sin_addr.s_addr == oa->sin_addr.s_addr; }
+#if defined(IPv6) && defined(AF_INET6)
+    case AF_INET6: {
+        struct sockaddr_in6 *na = (struct sockaddr_in6 *)a1;
+        struct sockaddr_in6 *oa = (struct sockaddr_in6 *)a2;
+        return (!withPort || na->sin6_port == oa->sin6_port) &&
+               !memcmp(&na->sin6_addr, &oa->sin6_addr, 16); }
+#endif
+    default: /* ... */
+        return False;
+    }
+}
+
+static unsigned long pingStamp;
+static int pingTokens;
+
 static void
-doPingHosts()
+startPingRound(void)
 {
     HostAddr *hosts;
+    HostName *h;
 
-    for (hosts = hostAddrdb; hosts; hosts = hosts->next)
+    for (h = hostNamedb; h; h = h->next)
+        h->alive = False;
+    pingStamp = nowMsecs();
+    pingTokens = PING_BURST;
+    for (hosts = hostAddrdb; hosts; hosts = hosts->next) {
+        hosts->tries = 0;
+        hosts->due = pingStamp;
+    }
+}
+
+/*
+ * Send the pings which are due, as far as the rate limit permits.
+ * Returns the number of msecs until the next call is needed, or -1
+ * if the ping round is over.
+ */
+static long
+doPingHosts(void)
+{
+    HostAddr *hosts;
+    unsigned long tnow;
+    long left, next = -1;
+    int n;
+
+    tnow = nowMsecs();
+    if ((n = (tnow - pingStamp) * PING_RATE / 1000)) {
+        pingStamp += n * 1000 / PING_RATE;
+        if ((pingTokens += n) > PING_BURST) {
+            pingTokens = PING_BURST;
+            pingStamp = tnow;
+        }
+    }
+    for (hosts = hostAddrdb; hosts; hosts = hosts->next) {
+        left = (long)(hosts->due - tnow);
+        if (hosts->tries >= PING_TRIES) {
+            if (left <= 0)
+                continue; /* done with this one */
+        } else if (left <= 0) {
+            if (!pingTokens) {
+                next = 1000 / PING_RATE;
+                continue;
+            }
+            pingTokens--;
 #if defined(IPv6) && defined(AF_INET6)
-        XdmcpFlush(hosts->addr->sa_family == AF_INET6 ? socket6FD : socketFD,
+            XdmcpFlush(hosts->addr->sa_family == AF_INET6 ? socket6FD : socketFD,
 #else
-        XdmcpFlush(socketFD,
+            XdmcpFlush(socketFD,
 #endif
-                   hosts->type == QUERY ? &directBuffer : &broadcastBuffer,
-                   (XdmcpNetaddr)hosts->addr, hosts->addrlen);
+                       hosts->type == QUERY ? &directBuffer : &broadcastBuffer,
+                       (XdmcpNetaddr)hosts->addr, hosts->addrlen);
+            left = PING_INTERVAL << hosts->tries++;
+            hosts->due = tnow + left;
+        }
+        if (next < 0 || left < next)
+            next = left;
+    }
+    return next;
+}
+
+/* a unicast host which answered needs no further pings in this round */
+static void
+pingAnswered(struct sockaddr *addr)
+{
+    HostAddr *hosts;
+
+    for (hosts = hostAddrHash[hashSockAddr(addr)]; hosts; hosts = hosts->hnext)
+        if (hosts->type == QUERY && sockAddrEqual(hosts->addr, addr, False)) {
+            hosts->tries = PING_TRIES;
+            hosts->due = nowMsecs();
+        }
+}
+
+static void
+markHostDirty(HostName *name, int how)
+{
+    if (name->dirty == HN_CLEAN) {
+        if (!dirtyHosts++)
+            dirtySince = nowMsecs();
+        name->dirty = how;
+    }
+}
+
+static void
+sendHost(HostName *name, int cmd)
+{
+    gSendInt(cmd);
+    gSendInt((int)(long)name); /* just an id */
+    if (cmd != G_Ch_RemoveHost) {
+        gSendNStr((char *)name->hostname.data, name->hostname.length);
+        gSendNStr((char *)name->status.data, name->status.length);
+        gSendInt(name->willing);
+    }
+}
+
+/* send all accumulated additions and changes in one go */
+static void
+flushHosts(void)
+{
+    HostName *h;
+
+    if (!dirtyHosts)
+        return;
+    gSendInt(G_Ch_HostBatch);
+    gSendInt(dirtyHosts);
+    for (h = hostNamedb; h; h = h->next)
+        if (h->dirty != HN_CLEAN) {
+            sendHost(h, h->dirty == HN_ADDED ? G_Ch_AddHost : G_Ch_ChangeHost);
+            h->dirty = HN_CLEAN;
+        }
+    dirtyHosts = 0;
 }
 
 static int
 addHostname(ARRAY8Ptr hostname, ARRAY8Ptr status,
             struct sockaddr *addr, int will)
 {
-    HostName **names, *name;
+    HostName *name;
     ARRAY8 hostAddr;
     CARD16 connectionType;
+    unsigned hash;
 
     switch (addr->sa_family) {
     case AF_INET:
@@ -260,20 +448,21 @@ addHostname(ARRAY8Ptr hostname, ARRAY8Ptr status,
         connectionType = FamilyLocal;
         break;
     }
-    for (names = &hostNamedb; *names; names = &(*names)->next) {
-        name = *names;
+    pingAnswered(addr);
+    hash = hashBytes(hostAddr.data, hostAddr.length);
+    for (name = hostNameHash[hash]; name; name = name->hnext)
         if (connectionType == name->connectionType &&
             XdmcpARRAY8Equal(&hostAddr, &name->hostaddr))
         {
+            name->alive = True;
             if (XdmcpARRAY8Equal(status, &name->status))
                 return False;
             XdmcpDisposeARRAY8(&name->status);
             XdmcpDisposeARRAY8(hostname);
 
-            gSendInt(G_Ch_ChangeHost);
+            markHostDirty(name, HN_CHANGED);
             goto gotold;
         }
-    }
     if (!(name = Malloc(sizeof(*name))))
         return False;
     if (hostname->length) {
@@ -305,20 +494,18 @@ addHostname(ARRAY8Ptr hostname, ARRAY8Ptr status,
     name->connectionType = connectionType;
     name->hostname = *hostname;
 
-    *names = name;
-    name->next = 0;
+    name->next = hostNamedb;
+    hostNamedb = name;
+    name->hnext = hostNameHash[hash];
+    hostNameHash[hash] = name;
+    name->dirty = HN_CLEAN;
+    name->alive = True;
 
-    gSendInt(G_Ch_AddHost);
+    markHostDirty(name, HN_ADDED);
   gotold:
-    name->alive = True;
     name->willing = will;
     name->status = *status;
 
-    gSendInt((int)(long)name); /* just an id */
-    gSendNStr((char *)name->hostname.data, name->hostname.length);
-    gSendNStr((char *)name->status.data, name->status.length);
-    gSendInt(will);
-
     return True;
 }
 
@@ -341,6 +528,35 @@ emptyHostnames(void)
         disposeHostname(host);
     }
     hostNamedb = 0;
+    bzero(hostNameHash, sizeof(hostNameHash));
+    dirtyHosts = 0;
+}
+
+static void
+removeDeadHosts(void)
+{
+    HostName **hp, **hhp, *h;
+    int cnt;
+
+    flushHosts();
+    for (cnt = 0, h = hostNamedb; h; h = h->next)
+        if (!h->alive)
+            cnt++;
+    if (!cnt)
+        return;
+    gSendInt(G_Ch_HostBatch);
+    gSendInt(cnt);
+    for (hp = &hostNamedb; (h = *hp);)
+        if (!h->alive) {
+            *hp = h->next;
+            for (hhp = &hostNameHash[hashBytes(h->hostaddr.data, h->hostaddr.length)];
+                 *hhp != h; hhp = &(*hhp)->hnext);
+            *hhp = h->hnext;
+            sendHost(h, G_Ch_RemoveHost);
+            disposeHostname(h);
+        } else {
+            hp = &h->next;
+        }
 }
 
 static void
@@ -405,30 +621,19 @@ static void
 addHostaddr(HostAddr **hosts, struct sockaddr *addr, int len, xdmOpCode type)
 {
     HostAddr *host;
+    unsigned hash;
 
     debug("adding host %[*hhu, type %d\n", len, addr, type);
-    for (host = *hosts; host; host = host->next)
-        if (host->type == type && host->addr->sa_family == addr->sa_family)
-            switch (addr->sa_family) {
-            case AF_INET: {
-                struct sockaddr_in *na = (struct sockaddr_in *)addr;
-                struct sockaddr_in *oa = (struct sockaddr_in *)host->addr;
-                if (na->sin_port == oa->sin_port &&
-                        na->sin_addr.s_addr == oa->sin_addr.s_addr)
-                    return;
-                break; }
-#if defined(IPv6) && defined(AF_INET6)
-            case AF_INET6: {
-                struct sockaddr_in6 *na = (struct sockaddr_in6 *)addr;
-                struct sockaddr_in6 *oa = (struct sockaddr_in6 *)host->addr;
-                if (na->sin6_port == oa->sin6_port &&
-                        !memcmp(&na->sin6_addr, &oa->sin6_addr, 16))
-                    return;
-                break; }
-#endif
-            default: /* ... */
-                break;
-            }
+    hash = hashSockAddr(addr);
+    if (hosts == &hostAddrdb) {
+        for (host = hostAddrHash[hash]; host; host = host->hnext)
+            if (host->type == type && sockAddrEqual(host->addr, addr, True))
+                return;
+    } else {
+        for (host = *hosts; host; host = host->next)
+            if (host->type == type && sockAddrEqual(host->addr, addr, True))
+                return;
+    }
     debug(" not dupe\n");
     if (!(host = Malloc(sizeof(*host))))
         return;
@@ -439,8 +644,14 @@ addHostaddr(HostAddr **hosts, struct sockaddr *addr, int len, xdmOpCode type)
     memcpy(host->addr, addr, len);
     host->addrlen = len;
     host->type = type;
+    host->tries = 0;
+    host->due = nowMsecs();
     host->next = *hosts;
     *hosts = host;
+    if (hosts == &hostAddrdb) {
+        host->hnext = hostAddrHash[hash];
+        hostAddrHash[hash] = host;
+    }
 }
 
 static void
@@ -460,6 +671,8 @@ emptyPingHosts(void)
         free(host);
     }
     hostAddrdb = 0;
+    bzero(hostAddrHash, sizeof(hostAddrHash));
+    broadcastRegistered = False;
 }
 
 /* Handle variable length ifreq in BNR2 and later */
@@ -483,6 +696,11 @@ registerBroadcastForPing(void)
 {
     struct sockaddr_in in_addr;
 
+    /* the interfaces are not going to change while the chooser runs */
+    if (broadcastRegistered)
+        return;
+    broadcastRegistered = True;
+
 #ifdef __GNU__
     in_addr.sin_addr.s_addr = htonl(0xFFFFFFFF);
     in_addr.sin_port = htons(XDM_UDP_PORT);
@@ -846,15 +1064,13 @@ directChooseHost(const char *name)
     }
 }
 
-#define PING_TRIES 3
-
 int
 doChoose(time_t *startTime)
 {
-    HostName **hp, *h;
     char *host, **hostp;
-    struct timeval *to, tnow, nextPing;
-    int pingTry, n, cmd;
+    struct timeval *to, tv;
+    long pto, fto;
+    int pinging, n, cmd;
     fd_set rfds;
     static int xdmcpInited;
 
@@ -884,49 +1100,30 @@ doChoose(time_t *startTime)
     gSendInt(0); /* entering async mode signal */
 
   reping:
-    for (h = hostNamedb; h; h = h->next)
-        h->alive = False;
-    pingTry = 0;
-    goto pingen;
+    startPingRound();
+    pinging = True;
 
     for (;;) {
+        pto = -1;
+        if (pinging && (pto = doPingHosts()) < 0) {
+            pinging = False;
+            removeDeadHosts();
+        }
+        fto = -1;
+        if (dirtyHosts &&
+            (fto = (long)(dirtySince + FLUSH_INTERVAL - nowMsecs())) <= 0)
+        {
+            flushHosts();
+            fto = -1;
+        }
+        if (fto >= 0 && (pto < 0 || fto < pto))
+            pto = fto;
         to = 0;
-        if (pingTry <= PING_TRIES) {
-            gettimeofday(&tnow, 0);
-            if (nextPing.tv_sec < tnow.tv_sec ||
-                (nextPing.tv_sec == tnow.tv_sec &&
-                 nextPing.tv_usec < tnow.tv_usec))
-            {
-                if (pingTry < PING_TRIES) {
-                  pingen:
-                    pingTry++;
-                    doPingHosts();
-                    gettimeofday(&tnow, 0);
-                    nextPing = tnow;
-                    nextPing.tv_sec++;
-                } else {
-                    for (hp = &hostNamedb; *hp;)
-                        if (!(*hp)->alive) {
-                            h = (*hp)->next;
-                            disposeHostname(*hp);
-                            gSendInt(G_Ch_RemoveHost);
-                            gSendInt((int)(long)*hp); /* just an id */
-                            *hp = h;
-                        } else {
-                            hp = &(*hp)->next;
-                        }
-                    goto noto;
-                }
-            }
-            to = &tnow;
-            tnow.tv_sec = nextPing.tv_sec - tnow.tv_sec;
-            tnow.tv_usec = nextPing.tv_usec - tnow.tv_usec;
-            if (tnow.tv_usec < 0) {
-                tnow.tv_usec += 1000000;
-                tnow.tv_sec--;
-            }
+        if (pto >= 0) {
+            to = &tv;
+            tv.tv_sec = pto / 1000;
+            tv.tv_usec = pto % 1000 * 1000;
         }
-      noto:
         FD_ZERO(&rfds);
         FD_SET(grtproc.pipe.fd.r, &rfds);
         FD_SET(socketFD, &rfds);
@@ -518,8 +518,8 @@ isNoPassAllowed(struct passwd *pw)
 # define LC_RET0 V_RET
 #endif
 
-int
-verify(GConvFunc gconv, int rootok)
+static int
+doVerify(GConvFunc gconv, int rootok)
 {
 #ifdef USE_PAM
     const char *psrv;
@@ -1029,6 +1029,20 @@ verify(GConvFunc gconv, int rootok)
 
 }
 
+int
+verify(GConvFunc gconv, int rootok)
+{
+    unsigned long msecs = nowMsecs();
+    int ret;
+
+    trace(TR_AuthStart, td->name, 0);
+    ret = doVerify(gconv, rootok);
+    /* not the user name; that may well be a mistyped password */
+    trace(TR_AuthEnd, td->name, ret);
+    reportStat(ST_Auth, nowMsecs() - msecs);
+    return ret;
+}
+
 
 static const char *envvars[] = {
     "TZ", /* SYSV and SVR4, but never hurts */
@@ -1290,6 +1304,104 @@ sendMsg(int lv, const char *msg, ...)
 }
 */
 
+/*
+ * Login timing. The steps of the login path are timed one after another,
+ * so the sum of the steps (apart from those of the helpers, which run
+ * concurrently) is the critical path from verification to the exec of
+ * the session.
+ */
+static unsigned long loginStart, stepStart;
+
+static void
+loginStep(const char *step)
+{
+    unsigned long t = nowMsecs();
+
+    debug("login step %s took %lu ms\n", step, t - stepStart);
+    trace(TR_LoginStep, step, t - stepStart);
+    stepStart = t;
+}
+
+/*
+ * Independent login steps are run in forked helpers, so they overlap
+ * with the main line. A helper reports a string (or nothing) back.
+ * If no helper can be forked, the step is run inline.
+ */
+typedef struct {
+    const char *what;
+    int pid, fd;
+    unsigned long start;
+} LoginJob;
+
+/* Returns True in the process which is supposed to do the job. */
+static int
+startJob(LoginJob *job, const char *what)
+{
+    int pfd[2];
+
+    job->what = what;
+    job->pid = -1;
+    job->start = nowMsecs();
+    if (pipe(pfd)) {
+        logError("Cannot create pipe for %s: %m\n", what);
+        return True;
+    }
+    /* the session must not inherit it, or joinJob() would wait for it */
+    fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pfd[1], F_SETFD, FD_CLOEXEC);
+    /* Fork() sets the pid only in the parent */
+    switch (Fork(&job->pid)) {
+    case 0:
+        job->pid = 0;
+        close(pfd[0]);
+        job->fd = pfd[1];
+        return True;
+    case -1:
+        logError("Cannot fork helper for %s: %m\n", what);
+        job->pid = -1;
+        close(pfd[0]);
+        close(pfd[1]);
+        return True;
+    default:
+        close(pfd[1]);
+        job->fd = pfd[0];
+        return False;
+    }
+}
+
+/* To be called by the job when it is done. Does not return in a helper. */
+static void
+endJob(LoginJob *job, const char *result)
+{
+    if (job->pid) /* run inline */
+        return;
+    trace(TR_LoginStep, job->what, nowMsecs() - job->start);
+    if (result)
+        writer(job->fd, result, strlen(result));
+    exit(0);
+}
+
+/* Wait for a helper. Returns its result, if any. */
+static char *
+joinJob(LoginJob *job)
+{
+    char buf[1024], tag[20], *ret = 0;
+    int len;
+
+    if (job->pid <= 0)
+        return 0;
+    len = reader(job->fd, buf, sizeof(buf) - 1);
+    close(job->fd);
+    (void)Wait4(&job->pid);
+    if (len > 0) {
+        buf[len] = 0;
+        strDup(&ret, buf);
+    }
+    sprintf(tag, "%.12s-wait", job->what);
+    loginStep(tag);
+    return ret;
+}
+
 int
 startClient(volatile int *pid)
 {
@@ -1322,8 +1434,10 @@ startClient(volatile int *pid)
 #endif
     char *failsafeArgv[2];
     char *buf, *buf2;
+    LoginJob authJob;
     int i;
 
+    loginStart = stepStart = nowMsecs();
     if (strCmp(dmrcuser, curuser)) {
         free(curdmrc);
         free(dmrcuser);
@@ -1402,6 +1516,7 @@ startClient(volatile int *pid)
         ck_connector_unref(ckConnector);
         ckConnector = 0;
     }
+    loginStep("consolekit");
 #endif
 
 #ifndef USE_PAM
@@ -1554,6 +1669,7 @@ startClient(volatile int *pid)
         resetGids();
         V_RET;
     }
+    loginStep("setcred");
 
     removeSession = True; /* set it first - same as above */
     pretc = pam_open_session(pamh, 0);
@@ -1564,6 +1680,7 @@ startClient(volatile int *pid)
         resetGids();
         V_RET;
     }
+    loginStep("open-session");
 
     /* we don't want sessreg and the startup/reset scripts run with user
        credentials. unfortunately, we can reset only the gids. */
@@ -1598,8 +1715,11 @@ startClient(volatile int *pid)
 
         setsid();
         Signal(SIGINT, SIG_DFL);
+        loginStep("fork");
 
-        sessreg(td, getpid(), curuser, curuid);
+        /* Wait until the master daemon has made the utmp entry. */
+        gSet(&ctltalk);
+        gRecvInt();
 
         /* We do this here, as we want to have the session as parent. */
         switch (source(systemEnviron, td->startup, td_setup)) {
@@ -1611,6 +1731,7 @@ startClient(volatile int *pid)
             logError("Startup script returned non-zero exit code\n");
             exit(1);
         }
+        loginStep("startup");
 
     /* Memory leaks are ok here as we exec() soon. */
 
@@ -1770,7 +1891,16 @@ startClient(volatile int *pid)
         }
         if (curpass)
             bzero(curpass, strlen(curpass));
-        setUserAuthorization(td);
+        loginStep("setuser");
+        /*
+         * Writing the Xauthority file (possibly to NFS) overlaps with the
+         * creation of the session log and the session setup below.
+         * The helper reports the XAUTHORITY to use.
+         */
+        if (startJob(&authJob, "xauth")) {
+            setUserAuthorization(td);
+            endJob(&authJob, getEnv(userEnviron, "XAUTHORITY"));
+        }
         home = getEnv(userEnviron, "HOME");
         if (home && chdir(home) < 0) {
             logError("Cannot chdir to %s's home %s: %m\n", curuser, home);
@@ -1792,6 +1922,7 @@ startClient(volatile int *pid)
                          td->clientLogFallback);
             /* Could inform the user, but I guess this is only confusing. */
         }
+        loginStep("client-log");
         if (!*dmrcDir)
             mergeSessionArgs(home != 0);
         if (!(desksess = iniEntry(curdmrc, "Desktop", "Session", 0)))
@@ -1827,6 +1958,12 @@ startClient(volatile int *pid)
         if (!(argv = parseArgs((char **)0, td->session)) ||
             !(argv = addStrArr(argv, sessargs, -1)))
             exit(1);
+        loginStep("session-args");
+        if ((str = joinJob(&authJob)))
+            userEnviron = setEnv(userEnviron, "XAUTHORITY", str);
+        free(str);
+        debug("login critical path took %lu ms\n", nowMsecs() - loginStart);
+        trace(TR_LoginStep, "total", nowMsecs() - loginStart);
         if (argv[0] && *argv[0]) {
             debug("executing session %\"[s\n", argv);
             execute(argv, userEnviron);
@@ -1852,8 +1989,20 @@ startClient(volatile int *pid)
     curpass = 0;
     END_ENT;
 
+    /*
+     * The master daemon does the utmp/wtmp/lastlog updates. It writes
+     * the entry right away, so it exists when Xstartup runs.
+     */
+    gSet(&mstrtalk);
+    gSendInt(D_SessReg);
+    gSendInt(*pid);
+    gSendStr(curuser);
+    gSendInt(curuid);
+    gRecvInt();
+
     gSet(&ctltalk);
-    if (!Setjmp(ctltalk.errjmp))
+    if (!Setjmp(ctltalk.errjmp)) {
+        gSendInt(0); /* let the session process go ahead */
         while (gRecvCmd(&i)) {
             buf = gRecvStr();
             displayStr(i, buf);
@@ -1861,6 +2010,7 @@ startClient(volatile int *pid)
             gSet(&ctltalk);
             gSendInt(0);
         }
+    }
     gClosen(ctltalk.pipe);
     finishGreet();
 
@@ -1887,7 +2037,8 @@ clientExited(void)
             logError("Reset script returned non-zero exit code\n");
             break;
         }
-        sessreg(td, 0, 0, 0);
+        /* The master daemon removes the utmp entry when it learns that
+         * the session is over. */
 
         switch (Fork(&pid)) {
         case 0:
@@ -1989,65 +2140,271 @@ sessionExit(int status)
     exit(status);
 }
 
-int
-readDmrc()
+/*
+ * The .dmrc files are read by a helper process which serves all lookups,
+ * so selecting a user does not cost a fork each time. The results are
+ * cached and revalidated by mtime; the greeter can queue lookups of users
+ * it expects to be selected, which are then answered in the background.
+ */
+typedef struct DmrcEnt {
+    struct DmrcEnt *next;
+    char *name;
+    char *data;         /* file contents; null if not read (yet) */
+    time_t mtime;
+    int status;         /* GE_*; -1 if not looked up yet */
+    int pending;        /* requests in the helper's queue */
+} DmrcEnt;
+
+#define DMRC_QUEUE 32
+
+static DmrcEnt *dmrcCache;
+static DmrcEnt *dmrcQueue[DMRC_QUEUE];
+static int dmrcQHead, dmrcQLen;
+static int dmrcPid, dmrcReqFd = -1, dmrcRepFd = -1;
+
+/*
+ * The helper switches only its effective ids for reading a .dmrc, so
+ * it must not go on if it cannot get back to a clean root state. It
+ * just exits then; the clients cope with it being gone.
+ */
+static void
+unbecomeUser(void)
 {
-    char *data, *fname = 0;
-    int len, pid, pfd[2], err;
+    if (seteuid(0) || setegid(0) || setgroups(0, 0) || getgroups(0, 0) > 0) {
+        logError("dmrc helper cannot reset its credentials: %m\n");
+        _exit(1);
+    }
+}
 
-    endpwent();
-    if (!dmrcuser || !dmrcuser[0] || !(p = getpwnam(dmrcuser)))
-        return GE_NoUser;
+static int
+becomeUser(struct passwd *pw)
+{
+    if (!initgroups(pw->pw_name, pw->pw_gid) && !setegid(pw->pw_gid) &&
+        !seteuid(pw->pw_uid))
+        return True;
+    /* this also drops what a partially successful initgroups() set */
+    unbecomeUser();
+    return False;
+}
 
-    if (*dmrcDir) {
-        if (!strApp(&fname, dmrcDir, "/", p->pw_name, ".dmrc", (char *)0))
-            return GE_Error;
-        if (!(curdmrc = iniLoad(fname))) {
-            free(fname);
-            return GE_Ok;
+static void
+dmrcHelper(int rfd, int wfd)
+{
+    struct passwd *pw;
+    struct stat st;
+    char *data, *fname, name[256];
+    time_t mtime;
+    int len, sts, asUser;
+
+    while (reader(rfd, &len, sizeof(len)) == sizeof(len) &&
+           len > 0 && len < (int)sizeof(name) &&
+           reader(rfd, name, len) == len &&
+           reader(rfd, &mtime, sizeof(mtime)) == sizeof(mtime))
+    {
+        name[len] = 0;
+        data = fname = 0;
+        len = -1;
+        asUser = False;
+        if (!(pw = getpwnam(name))) {
+            sts = GE_NoUser;
+        } else if (*dmrcDir ?
+                   !strApp(&fname, dmrcDir, "/", pw->pw_name, ".dmrc", (char *)0) :
+                   !strApp(&fname, pw->pw_dir, "/.dmrc", (char *)0))
+        {
+            sts = GE_Error;
+        } else if (!*dmrcDir && !(asUser = becomeUser(pw))) {
+            sts = GE_Error;
+        } else if (stat(fname, &st)) {
+            sts = *dmrcDir ? GE_NoFile : GE_Denied;
+        } else if (st.st_mtime == mtime) {
+            sts = GE_Ok; /* unchanged */
+        } else if (!(data = iniLoad(fname))) {
+            sts = *dmrcDir ? GE_NoFile : GE_Denied;
+        } else {
+            sts = GE_Ok;
+            mtime = st.st_mtime;
+            len = strlen(data);
         }
+        if (asUser)
+            unbecomeUser();
         free(fname);
-        return GE_NoFile;
+        endpwent();
+        if (writer(wfd, &sts, sizeof(sts)) != sizeof(sts) ||
+            writer(wfd, &mtime, sizeof(mtime)) != sizeof(mtime) ||
+            writer(wfd, &len, sizeof(len)) != sizeof(len) ||
+            (len > 0 && writer(wfd, data, len) != len))
+            break;
+        free(data);
     }
+    exit(0);
+}
 
-    if (!strApp(&fname, p->pw_dir, "/.dmrc", (char *)0))
-        return GE_Error;
-    if (pipe(pfd))
-        return GE_Error;
-    switch (Fork(&pid)) {
+static int
+startDmrcHelper(void)
+{
+    int rqfd[2], rpfd[2];
+
+    if (dmrcPid > 0)
+        return True;
+    if (pipe(rqfd))
+        return False;
+    if (pipe(rpfd)) {
+        close(rqfd[0]);
+        close(rqfd[1]);
+        return False;
+    }
+    switch (Fork(&dmrcPid)) {
     case -1:
-        close(pfd[0]);
-        close(pfd[1]);
-        return GE_Error;
+        close(rqfd[0]);
+        close(rqfd[1]);
+        close(rpfd[0]);
+        close(rpfd[1]);
+        return False;
     case 0:
-        if (!setUser(p->pw_name, p->pw_uid, p->pw_gid))
-            exit(0);
-        if (!(data = iniLoad(fname))) {
-            static const int m1 = -1;
-            write(pfd[1], &m1, sizeof(int));
-            exit(0);
-        }
-        len = strlen(data);
-        write(pfd[1], &len, sizeof(int));
-        write(pfd[1], data, len + 1);
-        exit(0);
-    }
-    close(pfd[1]);
-    free(fname);
-    err = GE_Error;
-    if (reader(pfd[0], &len, sizeof(int)) == sizeof(int)) {
-        if (len == -1) {
-            err = GE_Denied;
-        } else if ((curdmrc = Malloc(len + 1))) {
-            if (reader(pfd[0], curdmrc, len + 1) == len + 1) {
-                err = GE_Ok;
-            } else {
-                free(curdmrc);
-                curdmrc = 0;
-            }
+        close(rqfd[1]);
+        close(rpfd[0]);
+        dmrcHelper(rqfd[0], rpfd[1]);
+        /* NOTREACHED */
+    }
+    close(rqfd[0]);
+    close(rpfd[1]);
+    dmrcReqFd = rqfd[1];
+    dmrcRepFd = rpfd[0];
+    registerCloseOnFork(dmrcReqFd);
+    registerCloseOnFork(dmrcRepFd);
+    debug("dmrc helper started, pid %d\n", dmrcPid);
+    return True;
+}
+
+void
+endDmrcHelper(void)
+{
+    DmrcEnt *de;
+
+    if (dmrcPid <= 0)
+        return;
+    closeNclearCloseOnFork(dmrcReqFd);
+    closeNclearCloseOnFork(dmrcRepFd);
+    dmrcReqFd = dmrcRepFd = -1;
+    Wait4(&dmrcPid);
+    for (; dmrcQLen; dmrcQLen--) {
+        de = dmrcQueue[dmrcQHead];
+        dmrcQHead = (dmrcQHead + 1) % DMRC_QUEUE;
+        if (!--de->pending)
+            de->status = GE_Error;
+    }
+}
+
+static int
+recvDmrc(void)
+{
+    DmrcEnt *de = dmrcQueue[dmrcQHead];
+    char *data;
+    time_t mtime;
+    int sts, len;
+
+    if (reader(dmrcRepFd, &sts, sizeof(sts)) != sizeof(sts) ||
+        reader(dmrcRepFd, &mtime, sizeof(mtime)) != sizeof(mtime) ||
+        reader(dmrcRepFd, &len, sizeof(len)) != sizeof(len))
+        goto bust;
+    if (len >= 0) {
+        if (!(data = Malloc(len + 1)))
+            goto bust;
+        if (reader(dmrcRepFd, data, len) != len) {
+            free(data);
+            goto bust;
         }
+        data[len] = 0;
+        free(de->data);
+        de->data = data;
+    } else if (sts != GE_Ok) {
+        free(de->data);
+        de->data = 0;
+    }
+    de->mtime = mtime;
+    de->status = sts;
+    de->pending--;
+    dmrcQHead = (dmrcQHead + 1) % DMRC_QUEUE;
+    dmrcQLen--;
+    return True;
+
+  bust:
+    logError("dmrc helper died\n");
+    endDmrcHelper();
+    return False;
+}
+
+static int
+queueDmrc(DmrcEnt *de)
+{
+    int len = strlen(de->name);
+
+    if (!startDmrcHelper())
+        return False;
+    if (writer(dmrcReqFd, &len, sizeof(len)) != sizeof(len) ||
+        writer(dmrcReqFd, de->name, len) != len ||
+        writer(dmrcReqFd, &de->mtime, sizeof(de->mtime)) != sizeof(de->mtime))
+    {
+        endDmrcHelper();
+        return False;
+    }
+    dmrcQueue[(dmrcQHead + dmrcQLen++) % DMRC_QUEUE] = de;
+    de->pending++;
+    return True;
+}
+
+static DmrcEnt *
+findDmrc(const char *name)
+{
+    DmrcEnt *de;
+
+    for (de = dmrcCache; de; de = de->next)
+        if (!strcmp(de->name, name))
+            return de;
+    if (!(de = Calloc(1, sizeof(*de))))
+        return 0;
+    if (!strDup(&de->name, name)) {
+        free(de);
+        return 0;
+    }
+    de->status = -1;
+    de->next = dmrcCache;
+    dmrcCache = de;
+    return de;
+}
+
+void
+prefetchDmrc(const char *name)
+{
+    DmrcEnt *de;
+
+    if (!name || !name[0] || strlen(name) >= 256 || dmrcQLen == DMRC_QUEUE)
+        return;
+    if ((de = findDmrc(name)) && de->status < 0 && !de->pending)
+        queueDmrc(de);
+}
+
+int
+readDmrc()
+{
+    DmrcEnt *de;
+
+    if (!dmrcuser || !dmrcuser[0] || strlen(dmrcuser) >= 256)
+        return GE_NoUser;
+    if (!(de = findDmrc(dmrcuser)))
+        return GE_Error;
+    /* a queued lookup is fresh enough; otherwise revalidate */
+    if (!de->pending) {
+        while (dmrcQLen == DMRC_QUEUE)
+            if (!recvDmrc())
+                return GE_Error;
+        if (!queueDmrc(de))
+            return GE_Error;
     }
-    close(pfd[0]);
-    Wait4(&pid);
-    return err;
+    while (de->pending)
+        if (!recvDmrc())
+            return GE_Error;
+    if (de->status == GE_Ok && de->data)
+        strDup(&curdmrc, de->data);
+    return de->status;
 }
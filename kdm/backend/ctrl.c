@@ -315,6 +315,57 @@ unQuote(const char *str)
     return ret;
 }
 
+static void
+emitTimeline(int fd, struct display *d)
+{
+    char *bp, cbuf[256];
+    int i;
+
+    bp = cbuf + sprintf(cbuf, "\t%.128s", d->name);
+    for (i = 0; i < TL_NUM; i++)
+        if (d->timeline[i] < 0)
+            *bp++ = ',';
+        else
+            bp += sprintf(bp, ",%ld", d->timeline[i]);
+    writer(fd, cbuf, bp - cbuf);
+}
+
+static const char *statNames[] = {
+    "server-start", "xconnect", "greeter", "auth", "session", "logout"
+};
+
+typedef struct {
+    int fd;
+    Hist total[ST_NUM];
+} StatCtx;
+
+static void
+emitHist(int fd, const char *name, int stat, Hist *h)
+{
+    char *bp, cbuf[512];
+    int i;
+
+    if (!h->count)
+        return;
+    bp = cbuf + sprintf(cbuf, "\t%.128s,%s,%u,%lu,%lu", name, statNames[stat],
+                        h->count, h->sum, h->max);
+    for (i = 0; i < HIST_BUCKETS; i++)
+        bp += sprintf(bp, ",%u", h->buckets[i]);
+    writer(fd, cbuf, bp - cbuf);
+}
+
+static void
+emitStats(struct disphist *he, void *ctx)
+{
+    StatCtx *sc = (StatCtx *)ctx;
+    int i;
+
+    for (i = 0; i < ST_NUM; i++) {
+        emitHist(sc->fd, he->name, i, &he->stats[i]);
+        histMerge(&sc->total[i], &he->stats[i]);
+    }
+}
+
 static void
 sdCat(char **bp, SdRec *sdr)
 {
@@ -387,7 +438,6 @@ emitXSessC(struct display *di, struct display *d, void *ctx)
 static void
 emitTTYSessC(STRUCTUTMP *ut, struct display *d, void *ctx)
 {
-    struct passwd *pw;
     char *bp;
     int vt, l;
     char cbuf[sizeof(ut->ut_line) + sizeof(ut->ut_user) + sizeof(ut->ut_host) + 16];
@@ -425,7 +475,7 @@ emitTTYSessC(STRUCTUTMP *ut, struct display *d, void *ctx)
     if (*user &&
         (d ? ((d->allowNuke == SHUT_NONE ||
                (d->allowNuke == SHUT_ROOT && d->userSess)) &&
-              (!(pw = getpwnam(user)) || d->userSess != (int)pw->pw_uid)) :
+              (ttySessUid(ut) < 0 || d->userSess != ttySessUid(ut))) :
              !fifoAllowNuke))
         *bp++ = '!';
     writer((int)(long)ctx, cbuf, bp - cbuf);
@@ -465,7 +515,9 @@ processCtrl(const char *string, int len, int fd, struct display *d)
         if (!strcmp(ar[0], "caps")) {
             if (ar[1])
                 goto exce;
-            Reply("ok\tkdm\tlist\t");
+            Reply("ok\tkdm\tlist\ttimeline\tstats\t");
+            if (!d)
+                Reply("trace\t");
             if (bootManager != BO_NONE)
                 Reply("bootoptions\t");
             if (d) {
@@ -521,6 +573,53 @@ processCtrl(const char *string, int len, int fd, struct display *d)
             listSessions(flags, d, (void *)(long)fd, emitXSessC, emitTTYSessC);
             Reply("\n");
             goto bust;
+        } else if (!strcmp(ar[0], "timeline")) {
+            if (ar[1])
+                goto exce;
+            Reply("ok");
+            if (d)
+                emitTimeline(fd, d);
+            else
+                for (di = displays; di; di = di->next)
+                    emitTimeline(fd, di);
+            Reply("\n");
+            goto bust;
+        } else if (!strcmp(ar[0], "stats")) {
+            StatCtx sc;
+            char cbuf[64];
+            int i;
+
+            if (ar[1])
+                goto exce;
+            memset(&sc, 0, sizeof(sc));
+            sc.fd = fd;
+            Reply("ok");
+            if (d) {
+                emitStats(d->hstent, &sc);
+            } else {
+                forEachDispHist(emitStats, &sc);
+                for (i = 0; i < ST_NUM; i++)
+                    emitHist(fd, "*", i, &sc.total[i]);
+                writer(fd, cbuf, sprintf(cbuf, "\t*,remote,%d,%d",
+                                         liveRemoteDisplays(), lostRemoteServers));
+            }
+            Reply("\n");
+            goto bust;
+        } else if (!strcmp(ar[0], "trace")) {
+            int count = 0;
+
+            if (ar[1]) {
+                if (ar[2] || (count = atoi(ar[1])) <= 0)
+                    goto exce;
+            }
+            if (d) {
+                fLog(d, fd, "perm", "trace is available only globally");
+                goto bust;
+            }
+            Reply("ok");
+            dumpTrace(fd, count);
+            Reply("\n");
+            goto bust;
         } else if (!strcmp(ar[0], "reserve")) {
             if (ar[1]) { /* Formerly the timeout. Just ignore it. */
                 if (ar[2])
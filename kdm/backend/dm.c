@@ -57,6 +57,9 @@ from the copyright holder.
 #endif
 
 static void sigHandler(int n);
+#ifdef SA_SIGINFO
+static void sigUsr1Handler(int n, siginfo_t *si, void *ctx);
+#endif
 static int scanConfigs(int force);
 static void startDisplay(struct display *d);
 static void startDisplays(void);
@@ -66,8 +69,12 @@ static void startDisplays(void);
 static void exitDisplay(struct display *d, int endState, int serverCmd, int goodExit);
 static void rStopDisplay(struct display *d, int endState);
 static void mainLoop(void);
+#ifdef HAVE_VTS
+static int getActiveVT(int con);
+#endif
 
 static int signalFds[2];
+static unsigned long startMsecs;
 
 #if !defined(HAVE_SETPROCTITLE) && !defined(NOXDMTITLE)
 static char *title;
@@ -115,6 +122,7 @@ main(int argc, char **argv)
 #ifndef nowMonotonic
     nowMonotonic = sysconf(_SC_MONOTONIC_CLOCK) >= 200112L;
 #endif
+    startMsecs = nowMsecs();
 
 #if KDM_LIBEXEC_STRIP == -1
     prog = strrchr(argv[0], '/');
@@ -266,6 +274,8 @@ main(int argc, char **argv)
     if (parentPid != 1)
         becomeDaemon();
 
+    initTrace();
+
     /*
      * Step 1 - load configuration parameters
      */
@@ -305,7 +315,18 @@ main(int argc, char **argv)
     (void)Signal(SIGINT, sigHandler);
     (void)Signal(SIGHUP, sigHandler);
     (void)Signal(SIGCHLD, sigHandler);
+#ifdef SA_SIGINFO
+    {
+        struct sigaction sa;
+
+        sa.sa_sigaction = sigUsr1Handler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_SIGINFO;
+        sigaction(SIGUSR1, &sa, 0);
+    }
+#else
     (void)Signal(SIGUSR1, sigHandler);
+#endif
 
     // make certain every Qt application we spawn will use X11/XCB
     setenv("QT_QPA_PLATFORM", strdup("xcb"), 1);
@@ -313,11 +334,13 @@ main(int argc, char **argv)
     /*
      * Step 2 - run a sub-daemon for each entry
      */
+    initTTYSessions();
     openCtrl(0);
 #ifdef XDMCP
     updateListenSockets();
 #endif
     mainLoop();
+    flushSessreg();
     closeCtrl(0);
     if (sdRec.how) {
         int pid;
@@ -353,6 +376,30 @@ updateNow(void)
         time(&now);
 }
 
+/* Only differences of the returned values are meaningful. */
+unsigned long
+nowMsecs(void)
+{
+#if (_POSIX_MONOTONIC_CLOCK >= 0)
+    if (nowMonotonic) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    } else
+#endif
+    {
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return (unsigned long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+}
+
+void
+markTimeline(struct display *d, int ev)
+{
+    d->timeline[ev] = nowMsecs() - startMsecs;
+}
+
 
 #ifdef HAVE_VTS
 int
@@ -408,7 +455,8 @@ struct utmps {
 #define TIME_RELOG 10
 
 static struct utmps *utmpList;
-static time_t utmpTimeout = TO_INF;
+static void utmpTimeout(void *arg);
+static Timer utmpTimer = { 0, 0, 0, utmpTimeout, 0, 0 };
 
 void
 wakeDisplays(void)
@@ -539,14 +587,20 @@ checkUtmp(void)
                 nck = ends;
         } else
             nck = TIME_RELOG + now;
-        if (nck < utmpTimeout)
-            utmpTimeout = nck;
+        if (!timerPending(&utmpTimer) || nck < utmpTimer.expires)
+            armTimer(&utmpTimer, nck);
 #ifndef HAVE_VTS
         utpp = &(*utpp)->next;
     }
 #endif
 }
 
+static void
+utmpTimeout(void *arg ATTR_UNUSED)
+{
+    checkUtmp();
+}
+
 static void
 #ifdef HAVE_VTS
 switchToTTY(void)
@@ -708,14 +762,29 @@ setNLogin(struct display *d,
     debug("set next login for %s, level %d\n", nuser, rl);
 }
 
+int lostRemoteServers;
+
+int
+liveRemoteDisplays(void)
+{
+    struct display *d;
+    int cnt = 0;
+
+    for (d = displays; d; d = d->next)
+        if ((d->displayType & d_location) == dForeign &&
+            d->status == running && d->pid != -1)
+            cnt++;
+    return cnt;
+}
+
 static void
 processDPipe(struct display *d)
 {
     char *user, *pass, *args;
-    int cmd;
+    int cmd, len, pid, uid;
     GTalk dpytalk;
 #ifdef XDMCP
-    int ct, len;
+    int ct;
     ARRAY8 ca, cp, ha;
 #endif
 
@@ -730,6 +799,7 @@ processDPipe(struct display *d)
         unregisterInput(d->pipe.fd.r);
         return;
     }
+    trace(TR_MasterMsg, d->name, cmd);
     switch (cmd) {
     case D_User:
         d->userSess = gRecvInt();
@@ -737,6 +807,11 @@ processDPipe(struct display *d)
         d->sessName = gRecvStr();
         break;
     case D_UnUser:
+        d->hstent->logoutMsecs = nowMsecs();
+        if (d->sessregPid) {
+            sessreg(d, 0, 0, 0);
+            d->sessregPid = 0;
+        }
         sessionDone(d);
         if (d->sdRec.how) {
             if (d->sdRec.force == SHUT_ASK &&
@@ -790,7 +865,49 @@ processDPipe(struct display *d)
         break;
 #endif
     case D_XConnOk:
-        startingServer = 0;
+        startServerDone(d);
+        break;
+    case D_XConnLost:
+        if ((d->displayType & d_location) == dForeign) {
+            lostRemoteServers++;
+            logInfo("Remote display %s lost; %d remote displays alive, %d lost\n",
+                    d->name, liveRemoteDisplays() - 1, lostRemoteServers);
+        }
+        break;
+    case D_XConnTime:
+        len = gRecvInt();
+        markTimeline(d, TL_XConnect);
+        trace(TR_XConnect, d->name, len);
+        histAdd(&d->hstent->stats[ST_XConnect], len);
+        debug("X server %s accepted connection after %d ms"
+              " (%u connects, avg %lu ms, max %lu ms)\n",
+              d->name, len, d->hstent->stats[ST_XConnect].count,
+              d->hstent->stats[ST_XConnect].sum /
+                  d->hstent->stats[ST_XConnect].count,
+              d->hstent->stats[ST_XConnect].max);
+        break;
+    case D_SessReg:
+        pid = gRecvInt();
+        user = gRecvStr();
+        uid = gRecvInt();
+        sessreg(d, pid, user, uid);
+        d->sessregPid = pid;
+        free(user);
+        /* the session waits for its entry; don't let it sit in the queue */
+        flushSessreg();
+        gSendInt(0);
+        break;
+    case D_Stat:
+        cmd = gRecvInt();
+        len = gRecvInt();
+        if (cmd < 0 || cmd >= ST_NUM || len < 0)
+            break;
+        histAdd(&d->hstent->stats[cmd], len);
+        if (cmd == ST_Greeter && d->hstent->logoutMsecs) {
+            histAdd(&d->hstent->stats[ST_Logout],
+                    nowMsecs() - d->hstent->logoutMsecs);
+            d->hstent->logoutMsecs = 0;
+        }
         break;
     default:
         logError("Internal error: unknown D_* command %d\n", cmd);
@@ -969,9 +1086,14 @@ reapChildren(void)
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
         debug("manager wait returns  pid %d  sig %d  core %d  code %d\n",
               pid, waitSig(status), waitCore(status), waitCode(status));
+        trace(TR_Exit, 0, pid);
         /* SUPPRESS 560 */
         if ((d = findDisplayByPid(pid))) {
             d->pid = -1;
+            if (d->sessregPid) { /* the sub-daemon did not get to it */
+                sessreg(d, 0, 0, 0);
+                d->sessregPid = 0;
+            }
             unregisterInput(d->pipe.fd.r);
             gClosen(&d->pipe);
             unregisterInput(d->gpipe.fd.r);
@@ -1065,15 +1187,7 @@ reapChildren(void)
                     } else {
                         int con = open("/dev/console", O_RDONLY);
                         if (con >= 0) {
-                            int activevt;
-#if defined(__linux__)
-                            struct vt_stat vtstat;
-                            ioctl(con, VT_GETSTATE, &vtstat);
-                            activevt = vtstat.v_active;
-#elif defined(__FreeBSD_kernel__)
-                            ioctl(con, VT_GETACTIVE, &activevt);
-#endif
-                            if (activevt == d->serverVT) {
+                            if (getActiveVT(con) == d->serverVT) {
                                 int vt = 1;
                                 struct display *di;
                                 for (di = displays; di; di = di->next)
@@ -1114,10 +1228,10 @@ reapChildren(void)
                 /* don't kill again */
                 break;
             case running:
-                if (startingServer == d && d->serverStatus != ignore) {
+                if (d->serverStarting && d->serverStatus != ignore) {
                     if (d->serverStatus == starting && waitCode(status) != 47)
                         logError("X server died during startup\n");
-                    startServerFailed();
+                    startServerFailed(d);
                     break;
                 }
                 logError("X server for display %s terminated unexpectedly\n",
@@ -1201,13 +1315,64 @@ sigHandler(int n)
     errno = olderrno;
 }
 
+#ifdef SA_SIGINFO
+/* X servers announce readiness with SIGUSR1; pass on who sent it */
+static void
+sigUsr1Handler(int n, siginfo_t *si, void *ctx)
+{
+    int olderrno = errno;
+    char buf[1 + sizeof(int)];
+    int pid = si ? si->si_pid : 0;
+
+    (void)ctx;
+    buf[0] = (char)n;
+    memcpy(buf + 1, &pid, sizeof(int));
+    write(signalFds[1], buf, sizeof(buf));
+    errno = olderrno;
+}
+#endif
+
+/* nothing to do; the main loop re-evaluates the shutdown on every pass */
+static void
+shutdownTimeout(void *arg ATTR_UNUSED)
+{
+}
+
+static Timer sdTimer = { 0, 0, 0, shutdownTimeout, 0, 0 };
+
+static void
+checkShutdown(void)
+{
+    if (sdRec.how) {
+        if (sdRec.start != TO_INF && now < sdRec.start) {
+            armTimer(&sdTimer, sdRec.start);
+            return;
+        }
+        sdRec.start = TO_INF;
+        if (now >= sdRec.timeout) {
+            sdRec.timeout = TO_INF;
+            if (wouldShutdown())
+                stoppen(True);
+            else
+                cancelShutdown();
+        } else {
+            stoppen(False);
+            if (sdRec.timeout != TO_INF) {
+                armTimer(&sdTimer, sdRec.timeout);
+                return;
+            }
+        }
+    }
+    cancelTimer(&sdTimer);
+}
+
 static void
 mainLoop(void)
 {
     struct display *d;
     struct timeval *tvp, tv;
     time_t to;
-    int nready;
+    int nready, pid;
     char buf;
     fd_set reads;
 
@@ -1221,34 +1386,8 @@ mainLoop(void)
     {
         if (!stopping)
             startDisplays();
-#ifdef XDMCP
-        to = disposeIndirectHosts();
-#else
-        to = TO_INF;
-#endif
-        if (sdRec.how) {
-            if (sdRec.start != TO_INF && now < sdRec.start) {
-                /*if (sdRec.start < to)*/
-                    to = sdRec.start;
-            } else {
-                sdRec.start = TO_INF;
-                if (now >= sdRec.timeout) {
-                    sdRec.timeout = TO_INF;
-                    if (wouldShutdown())
-                        stoppen(True);
-                    else
-                        cancelShutdown();
-                } else {
-                    stoppen(False);
-                    /*if (sdRec.timeout < to)*/
-                        to = sdRec.timeout;
-                }
-            }
-        }
-        if (serverTimeout < to)
-            to = serverTimeout;
-        if (utmpTimeout < to)
-            to = utmpTimeout;
+        checkShutdown();
+        to = runTimers();
         if (to == TO_INF) {
             tvp = 0;
         } else {
@@ -1259,21 +1398,22 @@ mainLoop(void)
             tv.tv_usec = 0;
             tvp = &tv;
         }
+        if (pendingSessreg()) {
+            /* only poll; the records are written as soon as we are idle */
+            tv.tv_sec = tv.tv_usec = 0;
+            tvp = &tv;
+        }
         reads = wellKnownSocketsMask;
         nready = select(wellKnownSocketsMax + 1, &reads, 0, 0, tvp);
-        debug("select returns %d\n", nready);
+        debug("select returns %d, %d timers pending\n",
+              nready, pendingTimers());
         updateNow();
+        if (!nready)
+            flushSessreg();
 #ifdef NEED_ENTROPY
         addTimerEntropy();
 #endif
-        if (now >= serverTimeout) {
-            serverTimeout = TO_INF;
-            startServerTimeout();
-        }
-        if (now >= utmpTimeout) {
-            utmpTimeout = TO_INF;
-            checkUtmp();
-        }
+        runTimers();
         if (nready > 0) {
             /*
              * we restart after the first handled fd, as
@@ -1302,8 +1442,13 @@ mainLoop(void)
                         rescanConfigs(False);
                     break;
                 case SIGUSR1:
-                    if (startingServer && startingServer->serverStatus == starting)
-                        startServerSuccess();
+#ifdef SA_SIGINFO
+                    if (reader(signalFds[0], &pid, sizeof(pid)) != sizeof(pid))
+                        logPanic("Signal notification pipe broken.\n");
+#else
+                    pid = 0;
+#endif
+                    startServerReady(pid);
                     break;
                 }
                 continue;
@@ -1314,6 +1459,8 @@ mainLoop(void)
 #endif
             if (handleCtrl(&reads, 0))
                 continue;
+            if (handleTTYSessions(&reads))
+                continue;
             /* Must be last (because of the breaks)! */
           again:
             for (d = displays; d; d = d->next) {
@@ -1351,7 +1498,7 @@ kickDisplay(struct display *d)
 {
     if (d->status == notRunning)
         startDisplay(d);
-    if (d->serverStatus == awaiting && !startingServer)
+    if (d->serverStatus == awaiting && canStartServer())
         startServer(d);
 }
 
@@ -1400,6 +1547,21 @@ getBusyVTs(void)
     return activeVTs;
 }
 
+static int
+getActiveVT(int con)
+{
+    int activevt = 0;
+#if defined(__linux__)
+    struct vt_stat vtstat;
+
+    if (!ioctl(con, VT_GETSTATE, &vtstat))
+        activevt = vtstat.v_active;
+#elif defined(__FreeBSD_kernel__)
+    ioctl(con, VT_GETACTIVE, &activevt);
+#endif
+    return activevt;
+}
+
 static void
 allocateVT(struct display *d)
 {
@@ -1452,21 +1614,55 @@ allocateVT(struct display *d)
 }
 #endif
 
+/*
+ * The display the user is most likely looking at: the one on the
+ * active VT, else the first configured permanent local display.
+ */
+static struct display *
+priorityDisplay(void)
+{
+    struct display *d, *pd = 0;
+#ifdef HAVE_VTS
+    int con, vt = 0;
+
+    if ((con = open("/dev/console", O_RDONLY)) >= 0) {
+        vt = getActiveVT(con);
+        close(con);
+    }
+    if (vt > 0)
+        for (d = displays; d; d = d->next)
+            if (d->serverVT == vt)
+                return d;
+#endif
+    /* newDisplay() prepends, so the last match is the first configured */
+    for (d = displays; d; d = d->next)
+        if ((d->displayType & (d_location | d_lifetime | d_origin)) ==
+                (dLocal | dPermanent | dFromFile))
+            pd = d;
+    return pd;
+}
+
 static void
 startDisplays(void)
 {
+    struct display *d;
+
     forEachDisplay(checkDisplayStatus);
     closeGetter();
 #ifdef HAVE_VTS
     activeVTs = -1;
     forEachDisplayRev(allocateVT);
 #endif
+    if ((d = priorityDisplay()))
+        kickDisplay(d);
     forEachDisplay(kickDisplay);
 }
 
 static void
 startDisplay(struct display *d)
 {
+    int i;
+
     if (stopping) {
         debug("stopping display %s because shutdown is scheduled\n", d->name);
         stopDisplay(d);
@@ -1479,6 +1675,8 @@ startDisplay(struct display *d)
 #endif
 
     d->status = running;
+    for (i = 0; i < TL_NUM; i++)
+        d->timeline[i] = -1;
     if ((d->displayType & d_location) == dLocal) {
         debug("startDisplay %s\n", d->name);
         /* don't bother pinging local displays; we'll
@@ -1496,6 +1694,7 @@ startDisplay(struct display *d)
             if (d->serverPid != -1 && d->resetForAuth)
                 kill(d->serverPid, SIGHUP);
         }
+        markTimeline(d, TL_Prepare);
         if (d->serverPid == -1) {
             d->serverStatus = awaiting;
             return;
@@ -1505,6 +1704,7 @@ startDisplay(struct display *d)
         /* this will only happen when using XDMCP */
         if (d->authorizations)
             saveServerAuthorizations(d, d->authorizations, d->authNum);
+        markTimeline(d, TL_Prepare);
     }
     startDisplayP2(d);
 }
@@ -1513,6 +1713,7 @@ void
 startDisplayP2(struct display *d)
 {
     char *cname, *cgname;
+    int connTime;
 
     openCtrl(d);
     debug("forking session\n");
@@ -1532,13 +1733,14 @@ startDisplayP2(struct display *d)
         mstrtalk.pipe = &d->pipe;
         (void)Signal(SIGPIPE, SIG_IGN);
         setAuthorization(d);
-        waitForServer(d);
-        if ((d->displayType & d_location) == dLocal) {
-            gSet(&mstrtalk);
-            if (Setjmp(mstrtalk.errjmp))
-                exit(EX_UNMANAGE_DPY);
+        connTime = waitForServer(d);
+        gSet(&mstrtalk);
+        if (Setjmp(mstrtalk.errjmp))
+            exit(EX_UNMANAGE_DPY);
+        gSendInt(D_XConnTime);
+        gSendInt(connTime);
+        if ((d->displayType & d_location) == dLocal)
             gSendInt(D_XConnOk);
-        }
         manageSession();
         /* NOTREACHED */
     case -1:
@@ -1547,6 +1749,7 @@ startDisplayP2(struct display *d)
         break;
     default:
         debug("forked session, pid %d\n", d->pid);
+        markTimeline(d, TL_SessionFork);
 
         /* (void) fcntl (d->pipe.fd.r, F_SETFL, O_NONBLOCK); */
         /* (void) fcntl (d->gpipe.fd.r, F_SETFL, O_NONBLOCK); */
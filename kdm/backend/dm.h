@@ -202,6 +202,40 @@ typedef enum serverStatus {
     pausing         /* startup failed, wait openDelay secs */
 } ServerStatus;
 
+typedef void (*TimerFunc)(void *arg);
+typedef struct Timer {
+    struct Timer *next, **pprev; /* pprev is null while not armed */
+    time_t expires;
+    TimerFunc func;
+    void *arg;
+    int level;                   /* wheel level; -1 = overdue */
+} Timer;
+#define timerPending(t) ((t)->pprev != 0)
+
+/* startup milestones of a display */
+#define TL_Prepare     0        /* authorization set up */
+#define TL_ServerFork  1        /* X server launched */
+#define TL_ServerReady 2        /* X server signaled readiness */
+#define TL_SessionFork 3        /* sub-daemon forked */
+#define TL_XConnect    4        /* sub-daemon connected to the X server */
+#define TL_NUM         5
+
+/* trace events; the tag is the display name unless noted */
+#define TR_Fork          0      /* arg: child pid */
+#define TR_Exec          1      /* tag: program */
+#define TR_Exit          2      /* arg: child pid */
+#define TR_ServerStart   3      /* arg: server pid */
+#define TR_ServerReady   4
+#define TR_XConnect      5      /* arg: msecs until accepted */
+#define TR_GreeterStart  6      /* arg: greeter pid */
+#define TR_GreeterReady  7
+#define TR_AuthStart     8
+#define TR_AuthEnd       9      /* arg: result */
+#define TR_SessionStart 10      /* arg: session pid */
+#define TR_GreeterMsg   11      /* arg: G_* command */
+#define TR_MasterMsg    12      /* arg: D_* command */
+#define TR_LoginStep    13      /* tag: step, arg: msecs */
+
 typedef struct {
     unsigned how:2,    /* 0=none 1=reboot 2=halt (SHUT_*) */
              force:2;
@@ -273,10 +307,14 @@ struct display {
     struct display *follower;   /* on exit, hand VT to this display */
 #endif
     ServerStatus serverStatus;  /* X server startup state */
+    int serverStarting;         /* X server start in progress */
+    Timer serverTimer;          /* timeout of current startup state */
     time_t lastStart;           /* time of last display start */
     int startTries;             /* current start try */
+    long timeline[TL_NUM];      /* msecs since daemon start; -1 = not reached */
     int stillThere;             /* state during HUP processing */
     int userSess;               /* -1=nobody, otherwise uid */
+    int sessregPid;             /* session with a utmp entry; 0 = none */
     char *userName;
     char *sessName;
     SdRec sdRec;                /* user session requested shutdown */
@@ -324,6 +362,23 @@ struct display {
 #define dFromXDMCP      8       /* started with XDMCP */
 #define dFromFile       0       /* started via entry in servers file */
 
+/* latency metrics of a display */
+#define ST_ServerStart 0        /* X server launch until readiness */
+#define ST_XConnect    1        /* until the X server accepted the connection */
+#define ST_Greeter     2        /* greeter launch until it is interactive */
+#define ST_Auth        3        /* user verification */
+#define ST_Session     4        /* session setup in startClient() */
+#define ST_Logout      5        /* session end until the next greeter is up */
+#define ST_NUM         6
+
+/* log2-bucketed histogram of durations in milliseconds */
+#define HIST_BUCKETS 20
+typedef struct {
+    unsigned count;
+    unsigned long sum, max;
+    unsigned buckets[HIST_BUCKETS]; /* [i] counts values below 2^i msecs */
+} Hist;
+
 struct disphist {
     struct disphist *next;
     char *name;
@@ -332,6 +387,8 @@ struct disphist {
              lock:1,      /* screen locker running */
              goodExit:1;  /* was the last exit "peaceful"? */
     char *nuser, *npass, *nargs;
+    unsigned long logoutMsecs; /* when the last session ended; 0 = n/a */
+    Hist stats[ST_NUM];   /* latency histograms */
 };
 
 #ifdef XDMCP
@@ -342,7 +399,7 @@ struct protoDisplay {
     struct protoDisplay *next;
     XdmcpNetaddr address;       /* UDP address */
     int addrlen;                /* UDP address length */
-    unsigned long date;         /* creation date */
+    Timer timer;                /* expiry */
     CARD16 displayNumber;
     CARD16 connectionType;
     ARRAY8 connectionAddress;
@@ -371,6 +428,10 @@ struct protoDisplay {
 #define D_RemoteHost 5
 #define D_XConnOk    6
 #define D_UnUser     7
+#define D_XConnTime  8
+#define D_XConnLost  9
+#define D_Stat       10 /* int metric, int msecs */
+#define D_SessReg    11 /* int pid, str user, int uid; int return */
 
 extern int debugLevel;
 
@@ -400,6 +461,8 @@ void setNLogin(struct display *d,
                const char *nuser, const char *npass, const char *nargs,
                int rl);
 void cancelShutdown(void);
+extern int lostRemoteServers;
+int liveRemoteDisplays(void);
 int TTYtoVT(const char *tty);
 int activateVT(int vt);
 
@@ -414,6 +477,8 @@ int activateVT(int vt);
 extern int nowMonotonic;
 #endif
 void updateNow(void);
+unsigned long nowMsecs(void);
+void markTimeline(struct display *d, int ev);
 
 /* in ctrl.c */
 void openCtrl(struct display *d);
@@ -426,6 +491,7 @@ void updateCtrl(void);
 extern struct display *displays; /* that's ugly ... */
 int anyDisplaysLeft(void);
 void forEachDisplay(void (*f)(struct display *));
+void forEachDispHist(void (*f)(struct disphist *, void *), void *ctx);
 #ifdef HAVE_VTS
 void forEachDisplayRev(void (*f)(struct display *));
 #endif
@@ -473,6 +539,7 @@ extern GTalk mstrtalk, grttalk;
 extern GProc grtproc;
 void openGreeter(void);
 int closeGreeter(int force);
+void reportStat(int stat, unsigned long msecs);
 int ctrlGreeterWait(int wreply, time_t *startTime);
 void prepareErrorGreet(void);
 void finishGreet(void);
@@ -499,6 +566,7 @@ void blockTerm(void);
 void unblockTerm(void);
 
 void gSet(GTalk *talk); /* call before gOpen! */
+GTalk *gGet(void);
 void gCloseOnExec(GPipe *pajp);
 int gFork(GPipe *pajp, const char *pname, char *cname,
           GPipe *ogp, char *cgname, GPipe *igp, volatile int *pid);
@@ -537,6 +605,8 @@ int startClient(volatile int *pid);
 void clientExited(void);
 void sessionExit(int status) ATTR_NORETURN;
 int readDmrc(void);
+void prefetchDmrc(const char *name);
+void endDmrcHelper(void);
 int changeUser(const char *user, const char *authfile);
 extern char **userEnviron, **systemEnviron;
 extern char *curuser, *curpass, *curtype, *newpass,
@@ -548,19 +618,32 @@ extern int cursource;
 
 /* server.c */
 char **prepareServerArgv(struct display *d, const char *args);
+int canStartServer(void);
 void startServer(struct display *d);
+void startServerDone(struct display *d);
 void abortStartServer(struct display *d);
-void startServerSuccess(void);
-void startServerFailed(void);
-void startServerTimeout(void);
-extern struct display *startingServer;
-extern time_t serverTimeout;
+void startServerReady(int pid);
+void startServerFailed(struct display *d);
+extern int startingServers;
 
-void waitForServer(struct display *d);
+int waitForServer(struct display *d);
 void resetServer(struct display *d);
 int pingServer(struct display *d);
+int watchServer(struct display *d, volatile int *pid);
 extern struct _XDisplay *dpy;
 
+/* timer.c */
+void initTimer(Timer *t, TimerFunc func, void *arg);
+void armTimer(Timer *t, time_t expires);
+void cancelTimer(Timer *t);
+int pendingTimers(void);
+time_t runTimers(void);
+
+/* in trace.c */
+void initTrace(void);
+void trace(int event, const char *tag, long arg);
+void dumpTrace(int fd, int count);
+
 /* in util.c */
 void *Calloc(size_t nmemb, size_t size);
 void *Malloc(size_t size);
@@ -597,10 +680,15 @@ int fGets(char *buf, int max, FILE *f);
 time_t mTime(const char *fn);
 void randomStr(char *s);
 int hexToBinary(char *out, const char *in);
+void histAdd(Hist *h, unsigned long msecs);
+void histMerge(Hist *h, const Hist *o);
 void listSessions(int flags, struct display *d, void *ctx,
                   void (*emitXSess)(struct display *, struct display *, void *),
                   void (*emitTTYSess)(STRUCTUTMP *, struct display *, void *));
 int anyUserLogins(int exclude_uid);
+void initTTYSessions(void);
+int handleTTYSessions(fd_set *reads);
+int ttySessUid(STRUCTUTMP *ut);
 
 struct expando {
     char key;
@@ -669,7 +757,6 @@ void forEachChooserHost(ARRAY8Ptr clientAddress, CARD16 connectionType, ChooserF
 void forEachListenAddr(ListenFunc listenfunction, ListenFunc mcastfcuntion, void **closure);
 
 /* in choose.c */
-time_t disposeIndirectHosts(void);
 ARRAY8Ptr indirectChoice(ARRAY8Ptr clientAddress, ARRAY8Ptr clientPort, CARD16 connectionType);
 int checkIndirectChoice(ARRAY8Ptr clientAddress, ARRAY8Ptr clientPort, CARD16 connectionType);
 void registerIndirectChoice(ARRAY8Ptr clientAddress, ARRAY8Ptr clientPort, CARD16 connectionType,
@@ -688,5 +775,7 @@ void processRequestSocket(int fd);
 
 /* in sessreg.c */
 void sessreg(struct display *d, int pid, const char *user, int uid);
+int pendingSessreg(void);
+void flushSessreg(void);
 
 #endif /* _DM_H_ */
@@ -112,6 +112,15 @@ forEachDisplay(void (*f)(struct display *))
     }
 }
 
+void
+forEachDispHist(void (*f)(struct disphist *, void *), void *ctx)
+{
+    struct disphist *hstent;
+
+    for (hstent = disphist; hstent; hstent = hstent->next)
+        (*f)(hstent, ctx);
+}
+
 #ifdef HAVE_VTS
 static void
 _forEachDisplayRev(struct display *d, void (*f)(struct display *))
@@ -202,6 +211,7 @@ removeDisplay(struct display *old)
         if (d == old) {
             debug("Removing display %s\n", d->name);
             *dp = d->next;
+            cancelTimer(&d->serverTimer);
             free(d->class2);
             free(d->cfg.data);
             delStr(d->cfg.dep.name);
@@ -248,6 +258,7 @@ newDisplay(const char *name)
 {
     struct display *d;
     struct disphist *hstent;
+    int i;
 
     if (!(hstent = findHist(name))) {
         if (!(hstent = Calloc(1, sizeof(*hstent))))
@@ -268,6 +279,8 @@ newDisplay(const char *name)
     /* initialize fields (others are 0) */
     d->pid = -1;
     d->serverPid = -1;
+    for (i = 0; i < TL_NUM; i++)
+        d->timeline[i] = -1;
     d->ctrl.fd = -1;
     d->pipe.fd.r = -1;
     d->gpipe.fd.r = -1;
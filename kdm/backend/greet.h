@@ -124,6 +124,7 @@ from the copyright holder.
 # define G_Ch_RemoveHost      303
 # define G_Ch_BadHost         304
 # define G_Ch_Exit            305
+# define G_Ch_HostBatch       306  /* int count, then count host updates */
 #endif
 #define G_SessMan           4   /* start "session manager" */
 #define G_ConfShutdown      5   /* confirm forced shutdown */
@@ -185,6 +186,7 @@ from the copyright holder.
 #define G_Console       116 /* ; async */
 #define G_AutoLogin     117 /* ; async */
 #define G_QryDpyShutdown 118 /* ; int, int, str */
+#define G_PrefetchDmrc  119 /* int count, count*str user; async */
 
 /*
  * Command codes core -> config reader
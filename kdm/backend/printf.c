@@ -95,90 +95,94 @@ from the copyright holder.
 #define DP_C_LONG   3
 #define DP_C_STR    10
 
-typedef void (*OutCh)(void *bp, char c);
+/*
+ * The output callback receives the formatted text in runs; single
+ * characters are only passed one by one where they need escaping.
+ */
+typedef void (*OutStr)(void *bp, const char *s, int len);
+
+static void
+outCh(OutStr out, void *bp, char c)
+{
+    out(bp, &c, 1);
+}
+
+static void
+outPad(OutStr out, void *bp, char c, int len)
+{
+    static const char spaces[] = "                ";
+    static const char zeros[] = "0000000000000000";
+    const char *pad = (c == '0') ? zeros : spaces;
+
+    while (len > 0) {
+        out(bp, pad, len < 16 ? len : 16);
+        len -= 16;
+    }
+}
 
 
 static void
-fmtint(OutCh dopr_outch, void *bp,
+fmtint(OutStr out, void *bp,
        long value, int base, int min, int max, int flags)
 {
     const char *ctab;
     unsigned long uvalue;
-    int signvalue = 0;
-    int place = 0;
     int spadlen = 0; /* amount to space pad */
     int zpadlen = 0; /* amount to zero pad */
-    char convert[20];
+    char convert[24], *cp = convert + sizeof(convert);
+    int place;
 
     if (max < 0)
         max = 0;
 
     uvalue = value;
 
-    if (!(flags & DP_F_UNSIGNED)) {
-        if (value < 0) {
-            signvalue = '-';
-            uvalue = -value;
-        } else if (flags & DP_F_PLUS) { /* Do a sign (+/i) */
-            signvalue = '+';
-        } else if (flags & DP_F_SPACE) {
-            signvalue = ' ';
-        }
-    }
-
     ctab = (flags & DP_F_UPCASE) ? "0123456789ABCDEF" : "0123456789abcdef";
+    if (!(flags & DP_F_UNSIGNED) && value < 0)
+        uvalue = -value;
     do {
-        convert[place++] = ctab[uvalue % (unsigned)base];
+        *--cp = ctab[uvalue % (unsigned)base];
         uvalue = uvalue / (unsigned)base;
     } while (uvalue);
+    place = convert + sizeof(convert) - cp;
 
     zpadlen = max - place;
-    spadlen = min - (max > place ? max : place) -
-              (signvalue ? 1 : 0) - ((flags & DP_F_NUM) ? 2 : 0);
     if (zpadlen < 0)
         zpadlen = 0;
+    if (!(flags & DP_F_UNSIGNED)) {
+        if (value < 0) {
+            *--cp = '-';
+        } else if (flags & DP_F_PLUS) { /* Do a sign (+/i) */
+            *--cp = '+';
+        } else if (flags & DP_F_SPACE) {
+            *--cp = ' ';
+        }
+    }
+    /* Prefix */
+    if (flags & DP_F_NUM) {
+        *--cp = 'x';
+        *--cp = '0';
+    }
+    spadlen = min - zpadlen - (convert + sizeof(convert) - cp);
     if (spadlen < 0)
         spadlen = 0;
     if (flags & DP_F_ZERO) {
         zpadlen = zpadlen > spadlen ? zpadlen : spadlen;
         spadlen = 0;
     }
-    if (flags & DP_F_MINUS)
-        spadlen = -spadlen; /* Left Justifty */
-
-
-    /* Spaces */
-    while (spadlen > 0) {
-        dopr_outch(bp, ' ');
-        --spadlen;
-    }
-
-    /* Sign */
-    if (signvalue)
-        dopr_outch(bp, signvalue);
-
-    /* Prefix */
-    if (flags & DP_F_NUM) {
-        dopr_outch(bp, '0');
-        dopr_outch(bp, 'x');
-    }
-
-    /* Zeros */
-    if (zpadlen > 0)
-        while (zpadlen > 0) {
-            dopr_outch(bp, '0');
-            --zpadlen;
-        }
-
-    /* Digits */
-    while (place > 0)
-        dopr_outch(bp, convert[--place]);
 
-    /* Left Justified spaces */
-    while (spadlen < 0) {
-        dopr_outch(bp, ' ');
-        ++spadlen;
+    if (!(flags & DP_F_MINUS))
+        outPad(out, bp, ' ', spadlen);
+    if (zpadlen) {
+        /* Sign and prefix go before the zeros */
+        int pfx = convert + sizeof(convert) - cp - place;
+        out(bp, cp, pfx);
+        cp += pfx;
+        outPad(out, bp, '0', zpadlen);
     }
+    out(bp, cp, convert + sizeof(convert) - cp);
+    if (flags & DP_F_MINUS) /* Left Justified spaces */
+        outPad(out, bp, ' ', spadlen);
 }
 
 typedef struct {
@@ -187,12 +191,10 @@ typedef struct {
 } str_t;
 
 static void
-putstr(OutCh dopr_outch, void *bp, str_t *st)
+putstr(OutStr out, void *bp, str_t *st)
 {
-    size_t pt;
-
-    for (pt = 0; pt < st->len; pt++)
-        dopr_outch(bp, st->str[pt]);
+    if (st->len)
+        out(bp, st->str, st->len);
 }
 
 static str_t _null_parents = { "(null)", 6 };
@@ -204,7 +206,7 @@ static str_t _null_caps = { "NULL", 4 };
 #endif
 
 static void
-fmtstr(OutCh dopr_outch, void *bp,
+fmtstr(OutStr out, void *bp,
        const char *value, int flags, int min, int max)
 {
     int padlen, strln, curcol;
@@ -216,10 +218,10 @@ fmtstr(OutCh dopr_outch, void *bp,
     if (!value) {
 #ifdef PRINT_QUOTES
         if (flags & (DP_F_SQUOTE | DP_F_DQUOTE))
-            putstr(dopr_outch, bp, &_null_caps);
+            putstr(out, bp, &_null_caps);
         else
 #endif
-            putstr(dopr_outch, bp, &_null_parents);
+            putstr(out, bp, &_null_parents);
         return;
     }
 
@@ -230,18 +232,26 @@ fmtstr(OutCh dopr_outch, void *bp,
     if (flags & DP_F_MINUS)
         padlen = -padlen; /* Left Justify */
 
-    for (; padlen > 0; padlen--)
-        dopr_outch(bp, ' ');
+    outPad(out, bp, ' ', padlen);
 #ifdef PRINT_QUOTES
     lastcol = 0;
     if (flags & DP_F_SQUOTE)
-        dopr_outch(bp, '\'');
+        outCh(out, bp, '\'');
     else if (flags & DP_F_DQUOTE)
-        dopr_outch(bp, '"');
+        outCh(out, bp, '"');
     else if (flags & DP_F_BACKSL)
         for (lastcol = strln; lastcol && value[lastcol - 1] == ' '; lastcol--);
 #endif
-    for (curcol = 0; curcol < strln; curcol++) {
+    curcol = 0;
+#ifdef PRINT_QUOTES
+    if (!(flags & (DP_F_SQUOTE | DP_F_DQUOTE | DP_F_BACKSL)))
+#endif
+    {
+        /* nothing to escape, so pass it on in one go */
+        out(bp, value, strln);
+        curcol = strln;
+    }
+    for (; curcol < strln; curcol++) {
         ch = value[curcol];
 #ifdef PRINT_QUOTES
         if (flags & (DP_F_SQUOTE | DP_F_DQUOTE | DP_F_BACKSL)) {
@@ -257,8 +267,8 @@ fmtstr(OutCh dopr_outch, void *bp,
                 if (ch < 32 ||
                     ((unsigned char)ch >= 0x7f && (unsigned char)ch < 0xa0))
                 {
-                    dopr_outch(bp, '\\');
-                    fmtint(dopr_outch, bp, (unsigned char)ch, 8, 3, 3, DP_F_ZERO);
+                    outCh(out, bp, '\\');
+                    fmtint(out, bp, (unsigned char)ch, 8, 3, 3, DP_F_ZERO);
                     continue;
                 } else {
                     if ((ch == '\'' && (flags & DP_F_SQUOTE)) ||
@@ -267,29 +277,28 @@ fmtstr(OutCh dopr_outch, void *bp,
                          (!curcol || curcol >= lastcol)) ||
                         ch == '\\')
                     {
-                        dopr_outch(bp, '\\');
+                        outCh(out, bp, '\\');
                     }
-                    dopr_outch(bp, ch);
+                    outCh(out, bp, ch);
                     continue;
                 }
             }
-            dopr_outch(bp, '\\');
+            outCh(out, bp, '\\');
         }
 #endif
-        dopr_outch(bp, ch);
+        outCh(out, bp, ch);
     }
 #ifdef PRINT_QUOTES
     if (flags & DP_F_SQUOTE)
-        dopr_outch(bp, '\'');
+        outCh(out, bp, '\'');
     else if (flags & DP_F_DQUOTE)
-        dopr_outch(bp, '"');
+        outCh(out, bp, '"');
 #endif
-    for (; padlen < 0; padlen++)
-        dopr_outch(bp, ' ');
+    outPad(out, bp, ' ', -padlen);
 }
 
 static void
-doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
+doPrint(OutStr out, void *bp, const char *format, va_list args)
 {
     const char *strvalue;
 #ifdef PRINT_ARRAYS
@@ -312,12 +321,10 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
     radix = 0;
     errn = errno;
     for (;;) {
-        for (;;) {
-            NCHR;
-            if (ch == '%')
-                break;
-            dopr_outch(bp, ch);
-        }
+        for (strvalue = format; *format && *format != '%'; format++);
+        if (format != strvalue)
+            out(bp, strvalue, format - strvalue);
+        NCHR;
         flags = cflags = min = 0;
         max = -1;
         for (;;) {
@@ -427,14 +434,14 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
         }
         switch (ch) {
         case '%':
-            dopr_outch(bp, ch);
+            outCh(out, bp, ch);
             break;
         case 'm':
             strvalue = (errn == -ENOSPC) ? "partial write" : strerror(errn);
-            fmtstr(dopr_outch, bp, strvalue, flags, min, max);
+            fmtstr(out, bp, strvalue, flags, min, max);
             break;
         case 'c':
-            dopr_outch(bp, va_arg(args, int));
+            outCh(out, bp, va_arg(args, int));
             break;
         case 's':
 #ifdef PRINT_ARRAYS
@@ -442,7 +449,7 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
             goto printit;
 #else
             strvalue = va_arg(args, char *);
-            fmtstr(dopr_outch, bp, strvalue, flags, min, max);
+            fmtstr(out, bp, strvalue, flags, min, max);
             break;
 #endif
         case 'u':
@@ -460,7 +467,7 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
 #ifdef PRINT_ARRAYS
             if (flags & DP_F_ARRAY) {
                 if (!(arptr = va_arg(args, void *))) {
-                    putstr(dopr_outch, bp,
+                    putstr(out, bp,
                            arpr.len ? &_null_caps : &_null_dparents);
                 } else {
                     if (arlen == -1) {
@@ -474,18 +481,18 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
                         }
                     }
                     if (flags & DP_F_COLON) {
-                        fmtint(dopr_outch, bp, (long)arlen, 10, 0, -1, DP_F_UNSIGNED);
-                        dopr_outch(bp, ':');
-                        dopr_outch(bp, ' ');
+                        fmtint(out, bp, (long)arlen, 10, 0, -1, DP_F_UNSIGNED);
+                        outCh(out, bp, ':');
+                        outCh(out, bp, ' ');
                     }
-                    putstr(dopr_outch, bp, &arpr);
+                    putstr(out, bp, &arpr);
                     for (aridx = 0; aridx < (unsigned)arlen; aridx++) {
                         if (aridx)
-                            putstr(dopr_outch, bp, &aresp);
-                        putstr(dopr_outch, bp, &arepr);
+                            putstr(out, bp, &aresp);
+                        putstr(out, bp, &arepr);
                         if (cflags == DP_C_STR) {
                             strvalue = ((char **)arptr)[aridx];
-                            fmtstr(dopr_outch, bp, strvalue, flags, min, max);
+                            fmtstr(out, bp, strvalue, flags, min, max);
                         } else {
                             if (flags & DP_F_UNSIGNED) {
                                 switch (cflags) {
@@ -502,16 +509,16 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
                                 default: value = ((int *)arptr)[aridx]; break;
                                 }
                             }
-                            fmtint(dopr_outch, bp, value, radix, min, max, flags);
+                            fmtint(out, bp, value, radix, min, max, flags);
                         }
-                        putstr(dopr_outch, bp, &aresf);
+                        putstr(out, bp, &aresf);
                     }
-                    putstr(dopr_outch, bp, &arsf);
+                    putstr(out, bp, &arsf);
                 }
             } else {
                 if (cflags == DP_C_STR) {
                     strvalue = va_arg(args, char *);
-                    fmtstr(dopr_outch, bp, strvalue, flags, min, max);
+                    fmtstr(out, bp, strvalue, flags, min, max);
                 } else {
 #endif
                     if (flags & DP_F_UNSIGNED) {
@@ -525,7 +532,7 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
                         default: value = va_arg(args, int); break;
                         }
                     }
-                    fmtint(dopr_outch, bp, value, radix, min, max, flags);
+                    fmtint(out, bp, value, radix, min, max, flags);
 #ifdef PRINT_ARRAYS
                 }
             }
@@ -533,7 +540,7 @@ doPrint(OutCh dopr_outch, void *bp, const char *format, va_list args)
             break;
         case 'p':
             value = (long)va_arg(args, void *);
-            fmtint(dopr_outch, bp, value, 16, sizeof(long) * 2 + 2,
+            fmtint(out, bp, value, 16, sizeof(long) * 2 + 2,
                    max, flags | DP_F_UNSIGNED | DP_F_ZERO | DP_F_NUM);
             break;
         }
@@ -565,12 +572,20 @@ static int lognums[] = { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERR, LOG_CRIT };
 
 static const char *lognams[] = { "debug", "info", "warning", "error", "panic" };
 
-static void
-logTime(char *dbuf)
+/* localtime() and strftime() are costly, so redo them only once a second */
+static const char *
+logTime(void)
 {
+    static time_t last = (time_t)-1;
+    static char dbuf[24];
     time_t tim;
+
     (void)time(&tim);
-    strftime(dbuf, 20, "%b %e %H:%M:%S", localtime(&tim));
+    if (tim != last) {
+        last = tim;
+        strftime(dbuf, sizeof(dbuf), "%b %e %H:%M:%S", localtime(&tim));
+    }
+    return dbuf;
 }
 
 #if defined(LOG_DEBUG_MASK) || defined(USE_SYSLOG)
@@ -598,85 +613,103 @@ logOutOfMem(void)
 #endif
     {
         int el;
-        char dbuf[24], sbuf[128];
-        logTime(dbuf);
+        char sbuf[128];
         el = sprintf(sbuf, "%s "
 #ifdef LOG_NAME
-                     LOG_NAME "[%ld]: " OOMSTR, dbuf,
+                     LOG_NAME "[%ld]: " OOMSTR, logTime(),
 #else
-                     "%s[%ld]: " OOMSTR, dbuf, prog,
+                     "%.40s[%ld]: " OOMSTR, logTime(), prog,
 #endif
                      (long)getpid());
         write(2, sbuf, el);
     }
 }
 
+/*
+ * Messages are assembled in a static buffer, so logging does not allocate.
+ * Complete lines are collected and written out together at the end of the
+ * message, or earlier if the buffer fills up. Lines which do not fit into
+ * the buffer at all are split.
+ */
+#ifndef LOG_BUFSIZE
+# define LOG_BUFSIZE 4096
+#endif
+
+static char logBuf[LOG_BUFSIZE];
+static int logBufBusy;
+
 typedef struct {
     char *buf;
-    int clen, blen, type;
-    char lmbuf[128];
+    int clen, blen, lstart, inLine, type;
+    int plen;
+    char prefix[128];
 } OCLBuf;
 
 static void
 flush_OCL(OCLBuf *oclbp)
 {
-    if (oclbp->clen) {
+    if (oclbp->lstart) {
+        write(2, oclbp->buf, oclbp->lstart);
+        oclbp->clen -= oclbp->lstart;
+        memmove(oclbp->buf, oclbp->buf + oclbp->lstart, oclbp->clen);
+        oclbp->lstart = 0;
+    }
+}
+
+static void
+endLine_OCL(OCLBuf *oclbp)
+{
 #ifdef USE_SYSLOG
-        if (!(debugLevel & DEBUG_NOSYSLOG))
-            syslog(lognums[oclbp->type], "%.*s", oclbp->clen, oclbp->buf);
-        else
+    if (!(debugLevel & DEBUG_NOSYSLOG)) {
+        syslog(lognums[oclbp->type], "%.*s",
+               oclbp->clen - oclbp->lstart, oclbp->buf + oclbp->lstart);
+        oclbp->clen = oclbp->lstart;
+    } else
 #endif
-        {
-            oclbp->buf[oclbp->clen] = '\n';
-            write(2, oclbp->buf, oclbp->clen + 1);
-        }
-        oclbp->clen = 0;
+    {
+        oclbp->buf[oclbp->clen++] = '\n';
+        oclbp->lstart = oclbp->clen;
     }
+    oclbp->inLine = 0;
 }
 
 static void
-outCh_OCL(void *bp, char c)
+out_OCL(void *bp, const char *s, int len)
 {
     OCLBuf *oclbp = (OCLBuf *)bp;
-    char *nbuf;
-    int nlen;
-
-    if (c == '\n') {
-        flush_OCL(oclbp);
-    } else {
-        if (oclbp->clen >= oclbp->blen - 1) {
-            if (oclbp->buf == oclbp->lmbuf) {
+    const char *nl;
+    int n, room;
+
+    while (len) {
+        nl = memchr(s, '\n', len);
+        n = nl ? nl - s : len;
+        if (n && !oclbp->inLine) {
+            if (oclbp->clen + oclbp->plen >= oclbp->blen - 1)
                 flush_OCL(oclbp);
-                oclbp->buf = 0;
-                oclbp->blen = 0;
-            }
-            nlen = oclbp->blen * 3 / 2 + 128;
-            nbuf = Realloc(oclbp->buf, nlen);
-            if (nbuf) {
-                oclbp->buf = nbuf;
-                oclbp->blen = nlen;
-            } else {
+            memcpy(oclbp->buf + oclbp->clen, oclbp->prefix, oclbp->plen);
+            oclbp->clen += oclbp->plen;
+            oclbp->inLine = 1;
+        }
+        room = oclbp->blen - 1 - oclbp->clen; /* keep space for the \n */
+        if (n > room) {
+            if (oclbp->lstart) {
                 flush_OCL(oclbp);
-                oclbp->buf = oclbp->lmbuf;
-                oclbp->blen = sizeof(oclbp->lmbuf);
+                continue;
             }
+            memcpy(oclbp->buf + oclbp->clen, s, room);
+            oclbp->clen += room;
+            s += room, len -= room;
+            endLine_OCL(oclbp);
+            continue;
         }
-#ifdef USE_SYSLOG
-        if (!oclbp->clen && (debugLevel & DEBUG_NOSYSLOG)) {
-#else
-        if (!oclbp->clen) {
-#endif
-            char dbuf[24];
-            logTime(dbuf);
-            oclbp->clen = sprintf(oclbp->buf, "%s "
-#ifdef LOG_NAME
-                                  LOG_NAME "[%ld] %s: ", dbuf,
-#else
-                                  "%s[%ld] %s: ", dbuf, prog,
-#endif
-                                  (long)getpid(), lognams[oclbp->type]);
+        memcpy(oclbp->buf + oclbp->clen, s, n);
+        oclbp->clen += n;
+        s += n, len -= n;
+        if (nl) {
+            s++, len--;
+            if (oclbp->inLine)
+                endLine_OCL(oclbp);
         }
-        oclbp->buf[oclbp->clen++] = c;
     }
 }
 
@@ -684,14 +717,37 @@ static void
 logger(int type, const char *fmt, va_list args)
 {
     OCLBuf oclb;
+    char lmbuf[256];
 
-    oclb.buf = 0;
-    oclb.blen = oclb.clen = 0;
+    if (logBufBusy) {
+        oclb.buf = lmbuf;
+        oclb.blen = sizeof(lmbuf);
+    } else {
+        logBufBusy = 1;
+        oclb.buf = logBuf;
+        oclb.blen = sizeof(logBuf);
+    }
+    oclb.clen = oclb.lstart = oclb.inLine = 0;
     oclb.type = type;
-    doPrint(outCh_OCL, &oclb, fmt, args);
-    /* no flush, every message is supposed to be \n-terminated */
-    if (oclb.buf && oclb.buf != oclb.lmbuf)
-        free(oclb.buf);
+#ifdef USE_SYSLOG
+    if (!(debugLevel & DEBUG_NOSYSLOG))
+        oclb.plen = 0;
+    else
+#endif
+    {
+        oclb.plen = sprintf(oclb.prefix, "%s "
+#ifdef LOG_NAME
+                            LOG_NAME "[%ld] %s: ", logTime(),
+#else
+                            "%.40s[%ld] %s: ", logTime(), prog,
+#endif
+                            (long)getpid(), lognams[type]);
+    }
+    doPrint(out_OCL, &oclb, fmt, args);
+    /* no flush of the last line, every message is supposed to be \n-terminated */
+    flush_OCL(&oclb);
+    if (oclb.buf == logBuf)
+        logBufBusy = 0;
 }
 
 #ifdef LOG_DEBUG_MASK
@@ -768,17 +824,17 @@ typedef struct {
 } OCFBuf;
 
 static void
-outCh_OCF(void *bp, char c)
+out_OCF(void *bp, const char *s, int len)
 {
     OCFBuf *ocfbp = (OCFBuf *)bp;
     char *nbuf;
     int nlen;
 
-    ocfbp->tlen++;
-    if (ocfbp->clen >= ocfbp->blen) {
+    ocfbp->tlen += len;
+    if (ocfbp->clen + len > ocfbp->blen) {
         if (ocfbp->blen < 0)
             return;
-        nlen = ocfbp->blen * 3 / 2 + 100;
+        nlen = (ocfbp->clen + len) * 3 / 2 + 100;
         nbuf = Realloc(ocfbp->buf, nlen);
         if (!nbuf) {
             free(ocfbp->buf);
@@ -790,7 +846,8 @@ outCh_OCF(void *bp, char c)
         ocfbp->blen = nlen;
         ocfbp->buf = nbuf;
     }
-    ocfbp->buf[ocfbp->clen++] = c;
+    memcpy(ocfbp->buf + ocfbp->clen, s, len);
+    ocfbp->clen += len;
 }
 
 STATIC int
@@ -800,7 +857,7 @@ FdPrintf(int fd, const char *fmt, ...)
     OCFBuf ocfb = { 0, 0, 0, -1 };
 
     va_start(args, fmt);
-    doPrint(outCh_OCF, &ocfb, fmt, args);
+    doPrint(out_OCF, &ocfb, fmt, args);
     va_end(args);
     if (ocfb.buf) {
         debug("FdPrintf %\".*s to %d\n", ocfb.clen, ocfb.buf, fd);
@@ -820,17 +877,17 @@ typedef struct {
 } OCABuf;
 
 static void
-outCh_OCA(void *bp, char c)
+out_OCA(void *bp, const char *s, int len)
 {
     OCABuf *ocabp = (OCABuf *)bp;
     char *nbuf;
     int nlen;
 
-    ocabp->tlen++;
-    if (ocabp->clen >= ocabp->blen) {
+    ocabp->tlen += len;
+    if (ocabp->clen + len > ocabp->blen) {
         if (ocabp->blen < 0)
             return;
-        nlen = ocabp->blen * 3 / 2 + 100;
+        nlen = (ocabp->clen + len) * 3 / 2 + 100;
         nbuf = Realloc(ocabp->buf, nlen);
         if (!nbuf) {
             free(ocabp->buf);
@@ -842,7 +899,8 @@ outCh_OCA(void *bp, char c)
         ocabp->blen = nlen;
         ocabp->buf = nbuf;
     }
-    ocabp->buf[ocabp->clen++] = c;
+    memcpy(ocabp->buf + ocabp->clen, s, len);
+    ocabp->clen += len;
 }
 
 STATIC int
@@ -850,8 +908,8 @@ VASPrintf(char **strp, const char *fmt, va_list args)
 {
     OCABuf ocab = { 0, 0, 0, -1 };
 
-    doPrint(outCh_OCA, &ocab, fmt, args);
-    outCh_OCA(&ocab, 0);
+    doPrint(out_OCA, &ocab, fmt, args);
+    out_OCA(&ocab, "", 1);
     *strp = Realloc(ocab.buf, ocab.clen);
     if (!*strp)
         *strp = ocab.buf;
@@ -158,6 +158,8 @@ Fork(volatile int *pidr)
         return 0;
     }
     *pidr = pid;
+    if (pid > 0)
+        trace(TR_Fork, 0, pid);
 
     sigprocmask(SIG_SETMASK, &oss, 0);
 
@@ -205,6 +207,7 @@ void
 execute(char **argv, char **env)
 {
     debug("execute: %[s ; %[s\n", argv, env);
+    trace(TR_Exec, argv[0], 0);
     execve(argv[0], argv, env);
     /*
      * In case this is a shell script which hasn't been
@@ -347,6 +350,12 @@ gSet(GTalk *tlk)
     curtalk = tlk;
 }
 
+GTalk *
+gGet(void)
+{
+    return curtalk;
+}
+
 void
 gCloseOnExec(GPipe *pajp)
 {
@@ -56,15 +56,10 @@ findProtoDisplay(XdmcpNetaddr address,
 }
 
 static void
-timeoutProtoDisplays(void)
+timeoutProtoDisplay(void *arg)
 {
-    struct protoDisplay *pdpy, *next;
-
-    for (pdpy = protoDisplays; pdpy; pdpy = next) {
-        next = pdpy->next;
-        if (pdpy->date < (unsigned long)(now - PROTO_TIMEOUT))
-            disposeProtoDisplay(pdpy);
-    }
+    debug("timing out proto display\n");
+    disposeProtoDisplay(arg);
 }
 
 struct protoDisplay *
@@ -75,7 +70,6 @@ newProtoDisplay(XdmcpNetaddr address, int addrlen, CARD16 displayNumber,
     struct protoDisplay *pdpy;
 
     debug("newProtoDisplay\n");
-    timeoutProtoDisplays();
     pdpy = Malloc(sizeof(*pdpy));
     if (!pdpy)
         return 0;
@@ -88,7 +82,6 @@ newProtoDisplay(XdmcpNetaddr address, int addrlen, CARD16 displayNumber,
     memmove(pdpy->address, address, addrlen);
     pdpy->displayNumber = displayNumber;
     pdpy->connectionType = connectionType;
-    pdpy->date = now;
     if (!XdmcpCopyARRAY8(connectionAddress, &pdpy->connectionAddress)) {
         free(pdpy->address);
         free(pdpy);
@@ -97,6 +90,8 @@ newProtoDisplay(XdmcpNetaddr address, int addrlen, CARD16 displayNumber,
     pdpy->sessionID = sessionID;
     pdpy->fileAuthorization = 0;
     pdpy->xdmcpAuthorization = 0;
+    initTimer(&pdpy->timer, timeoutProtoDisplay, pdpy);
+    armTimer(&pdpy->timer, now + PROTO_TIMEOUT);
     pdpy->next = protoDisplays;
     protoDisplays = pdpy;
     return pdpy;
@@ -119,6 +114,7 @@ disposeProtoDisplay(struct protoDisplay *pdpy)
         prev->next = pdpy->next;
     else
         protoDisplays = pdpy->next;
+    cancelTimer(&pdpy->timer);
     bzero(&pdpy->key, sizeof(pdpy->key));
     if (pdpy->fileAuthorization)
         XauDisposeAuth(pdpy->fileAuthorization);
@@ -42,10 +42,20 @@ from the copyright holder.
 
 #include <stdio.h>
 #include <signal.h>
+#ifdef TCPCONN
+# include <netdb.h>
+# include <netinet/tcp.h>
+#endif
+
 
+/*
+ * Local X servers are started concurrently. The server signals its
+ * readiness with a SIGUSR1; where the sender of a signal cannot be
+ * determined, the starts must be serialized.
+ */
+int startingServers;
 
-struct display *startingServer;
-time_t serverTimeout = TO_INF;
+static void startServerTimeout(void *arg);
 
 char **
 prepareServerArgv(struct display *d, const char *args)
@@ -74,9 +84,8 @@ prepareServerArgv(struct display *d, const char *args)
 }
 
 static void
-startServerOnce(void)
+startServerOnce(struct display *d)
 {
-    struct display *d = startingServer;
     char **argv;
 
     debug("startServerOnce for %s, try %d\n", d->name, ++d->startTries);
@@ -107,67 +116,111 @@ startServerOnce(void)
         exit(47);
     case -1:
         logError("X server fork failed\n");
-        startServerFailed();
+        startServerFailed(d);
         break;
     default:
         debug("X server forked, pid %d\n", d->serverPid);
-        serverTimeout = d->serverTimeout + now;
+        markTimeline(d, TL_ServerFork);
+        trace(TR_ServerStart, d->name, d->serverPid);
+        armTimer(&d->serverTimer, d->serverTimeout + now);
         break;
     }
 }
 
+int
+canStartServer(void)
+{
+#ifdef SA_SIGINFO
+    return True;
+#else
+    return !startingServers;
+#endif
+}
+
 void
 startServer(struct display *d)
 {
-    startingServer = d;
+    initTimer(&d->serverTimer, startServerTimeout, d);
+    d->serverStarting = True;
+    startingServers++;
     d->startTries = 0;
-    startServerOnce();
+    startServerOnce(d);
+}
+
+/* the sub-daemon is connected to the server; the start is complete */
+void
+startServerDone(struct display *d)
+{
+    if (d->serverStarting) {
+        d->serverStarting = False;
+        startingServers--;
+    }
 }
 
 void
 abortStartServer(struct display *d)
 {
-    if (startingServer == d) {
+    if (d->serverStarting) {
         if (d->serverStatus != ignore) {
             d->serverStatus = ignore;
-            serverTimeout = TO_INF;
+            cancelTimer(&d->serverTimer);
             debug("aborting X server start\n");
         }
-        startingServer = 0;
+        startServerDone(d);
     }
 }
 
-void
-startServerSuccess()
+static void
+startServerSuccess(struct display *d)
 {
-    struct display *d = startingServer;
     d->serverStatus = ignore;
-    serverTimeout = TO_INF;
-    debug("X server ready, starting session\n");
+    cancelTimer(&d->serverTimer);
+    markTimeline(d, TL_ServerReady);
+    trace(TR_ServerReady, d->name, 0);
+    if (d->timeline[TL_ServerFork] >= 0)
+        histAdd(&d->hstent->stats[ST_ServerStart],
+                d->timeline[TL_ServerReady] - d->timeline[TL_ServerFork]);
+    debug("X server for %s ready, starting session\n", d->name);
     startDisplayP2(d);
 }
 
+/* pid is the sender of the SIGUSR1, or zero if it is unknown */
 void
-startServerFailed()
+startServerReady(int pid)
+{
+    struct display *d;
+
+    for (d = displays; d; d = d->next)
+        if (d->serverStarting && d->serverStatus == starting &&
+            (!pid || d->serverPid == pid))
+        {
+            startServerSuccess(d);
+            return;
+        }
+    debug("got SIGUSR1 from unknown process %d\n", pid);
+}
+
+void
+startServerFailed(struct display *d)
 {
-    struct display *d = startingServer;
     if (!d->serverAttempts || d->startTries < d->serverAttempts) {
         d->serverStatus = pausing;
-        serverTimeout = d->openDelay + now;
+        armTimer(&d->serverTimer, d->openDelay + now);
     } else {
         d->serverStatus = ignore;
-        serverTimeout = TO_INF;
-        startingServer = 0;
+        cancelTimer(&d->serverTimer);
+        startServerDone(d);
         logError("X server for display %s cannot be started,"
                  " session disabled\n", d->name);
         stopDisplay(d);
     }
 }
 
-void
-startServerTimeout()
+static void
+startServerTimeout(void *arg)
 {
-    struct display *d = startingServer;
+    struct display *d = arg;
+
     switch (d->serverStatus) {
     case ignore:
     case awaiting:
@@ -176,20 +229,20 @@ startServerTimeout()
         logError("X server startup timeout, terminating\n");
         kill(d->serverPid, SIGTERM);
         d->serverStatus = terminated;
-        serverTimeout = d->serverTimeout + now;
+        armTimer(&d->serverTimer, d->serverTimeout + now);
         break;
     case terminated:
         logInfo("X server termination timeout, killing\n");
         kill(d->serverPid, SIGKILL);
         d->serverStatus = killed;
-        serverTimeout = 10 + now;
+        armTimer(&d->serverTimer, 10 + now);
         break;
     case killed:
         logInfo("X server is stuck in D state; leaving it alone\n");
-        startServerFailed();
+        startServerFailed(d);
         break;
     case pausing:
-        startServerOnce();
+        startServerOnce(d);
         break;
     }
 }
@@ -255,16 +308,187 @@ openErrorHandler(Display *dspl)
     return (0);
 }
 
-void
+/*
+ * Before handing the display name to Xlib, find out whether the server
+ * accepts connections at all. The probe uses a non-blocking connect()
+ * and select(), so it cannot hang like XOpenDisplay() can; a server
+ * which is still coming up is polled with a short, exponentially
+ * growing delay instead of a fixed OpenDelay pause.
+ */
+
+#define PROBE_MIN_DELAY 50 /* msecs */
+
+#ifndef X_TCP_PORT
+# define X_TCP_PORT 6000
+#endif
+
+/* See probeServer() for the return values. */
+static int
+probeAddr(struct sockaddr *sa, int salen, long tmo)
+{
+    struct timeval tv;
+    fd_set wfds;
+    int fd, err, ret;
+    socklen_t errlen;
+
+    if ((fd = socket(sa->sa_family, SOCK_STREAM, 0)) < 0)
+        return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (!connect(fd, sa, salen)) {
+        ret = 1;
+    } else if (errno == EINPROGRESS) {
+        FD_ZERO(&wfds);
+        FD_SET(fd, &wfds);
+        tv.tv_sec = tmo / 1000;
+        tv.tv_usec = tmo % 1000 * 1000;
+        ret = 0;
+        if (select(fd + 1, 0, &wfds, 0, &tv) > 0) {
+            errlen = sizeof(err);
+            if (!getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&err, &errlen) &&
+                !err)
+                ret = 1;
+        }
+    } else if (errno == ECONNREFUSED || errno == EAGAIN || errno == EINTR ||
+               errno == ETIMEDOUT) {
+        ret = 0; /* nobody listening yet */
+    } else {
+        ret = -1; /* no point in waiting for this one */
+    }
+    close(fd);
+    return ret;
+}
+
+/*
+ * Returns 1 if the server accepts connections, 0 if it does not (yet)
+ * and -1 if the display cannot be probed (in which case we just let
+ * Xlib have a go).
+ */
+static int
+probeServer(const char *name, long tmo)
+{
+    const char *colon;
+    int hlen, dnum;
+#ifdef UNIXCONN
+    struct sockaddr_un sa_un;
+#endif
+#ifdef TCPCONN
+# if defined(IPv6) && defined(AF_INET6)
+    struct addrinfo *ai, hints;
+    char port[12];
+    int ret;
+# else
+    struct sockaddr_in sin;
+    struct hostent *hostent;
+# endif
+    char host[256];
+#endif
+
+    if (!(colon = strrchr(name, ':')) || (colon > name && colon[-1] == ':'))
+        return -1; /* DECnet */
+    hlen = colon - name;
+    dnum = atoi(colon + 1);
+    if (!hlen || (hlen == 4 && !memcmp(name, "unix", 4))) {
+#ifdef UNIXCONN
+        bzero(&sa_un, sizeof(sa_un));
+        sa_un.sun_family = AF_UNIX;
+        sprintf(sa_un.sun_path, "/tmp/.X11-unix/X%d", dnum);
+        /*
+         * The server may listen only on an abstract socket or live in
+         * another /tmp; Xlib knows better then.
+         */
+        if (access(sa_un.sun_path, F_OK))
+            return -1;
+        return probeAddr((struct sockaddr *)&sa_un, sizeof(sa_un), tmo);
+#else
+        return -1;
+#endif
+    }
+#ifdef TCPCONN
+    if (hlen >= (int)sizeof(host))
+        return -1;
+    memcpy(host, name, hlen);
+    host[hlen] = 0;
+# if defined(IPv6) && defined(AF_INET6)
+    sprintf(port, "%d", X_TCP_PORT + dnum);
+    bzero(&hints, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &ai))
+        return -1;
+    ret = probeAddr(ai->ai_addr, ai->ai_addrlen, tmo);
+    freeaddrinfo(ai);
+    return ret;
+# else
+    if (!(hostent = gethostbyname(host)) || hostent->h_addrtype != AF_INET)
+        return -1;
+    bzero(&sin, sizeof(sin));
+    sin.sin_family = AF_INET;
+    memcpy(&sin.sin_addr, hostent->h_addr, 4);
+    sin.sin_port = htons(X_TCP_PORT + dnum);
+#  ifdef HAVE_STRUCT_SOCKADDR_IN_SIN_LEN
+    sin.sin_len = sizeof(sin);
+#  endif
+    return probeAddr((struct sockaddr *)&sin, sizeof(sin), tmo);
+# endif
+#else
+    return -1;
+#endif
+}
+
+static void
+sleepMsecs(unsigned long msecs)
+{
+    struct timeval tv;
+
+    tv.tv_sec = msecs / 1000;
+    tv.tv_usec = msecs % 1000 * 1000;
+    select(0, 0, 0, 0, &tv);
+}
+
+/*
+ * Returns the time in milliseconds it took until the server accepted
+ * the connection.
+ */
+int
 waitForServer(struct display *d)
 {
     volatile int i;
-    /* static int i; */
-
+    volatile unsigned long delay;
+    unsigned long start, deadline, maxDelay;
+    long left;
+    int ready;
+
+    start = nowMsecs();
+    delay = PROBE_MIN_DELAY;
+    maxDelay = d->openDelay > 0 ? d->openDelay * 1000UL : PROBE_MIN_DELAY;
     i = 0;
     do {
+        deadline = nowMsecs() + d->openTimeout * 1000UL;
+        for (;;) {
+            left = (long)(deadline - nowMsecs());
+            if ((ready = probeServer(d->name, left > 0 ? left : 0)))
+                break;
+            if (left <= 0) {
+                /* maybe the probe is wrong; Xlib has the final say */
+                logWarn("%s does not accept connections\n", d->name);
+                break;
+            }
+            debug("%s does not accept connections yet, retrying in %lu ms\n",
+                  d->name, delay);
+            sleepMsecs(delay < (unsigned long)left ? delay : (unsigned long)left);
+            if ((delay *= 2) > maxDelay)
+                delay = maxDelay;
+        }
+        /*
+         * The server is listening, so the remaining handshake is not
+         * supposed to take long. The alarm merely guards against
+         * servers which accept the connection and then get stuck.
+         * If the probe gave up, the deadline is (nearly) used up
+         * already, so Xlib gets only what is left of it.
+         */
         (void)Signal(SIGALRM, abortOpen);
-        (void)alarm((unsigned)d->openTimeout);
+        left = (long)(deadline - nowMsecs());
+        (void)alarm(ready ? (unsigned)d->openTimeout :
+                    left > 1000 ? (unsigned)((left + 999) / 1000) : 1);
         if (!Setjmp(openAbort)) {
             debug("before XOpenDisplay(%s)\n", d->name);
             errno = 0;
@@ -292,10 +516,12 @@ waitForServer(struct display *d)
                     getRemoteAddress(d, ConnectionNumber(dpy));
 #endif
                 registerCloseOnFork(ConnectionNumber(dpy));
-                return;
+                return (int)(nowMsecs() - start);
             }
             debug("OpenDisplay(%s) attempt %d failed: %m\n", d->name, i + 1);
-            sleep((unsigned)d->openDelay);
+            sleepMsecs(delay);
+            if ((delay *= 2) > maxDelay)
+                delay = maxDelay;
         } else {
             logError("Hung in XOpenDisplay(%s), aborting\n", d->name);
             (void)Signal(SIGALRM, SIG_DFL);
@@ -306,7 +532,6 @@ waitForServer(struct display *d)
     exit(EX_OPENFAILED_DPY);
 }
 
-
 void
 resetServer(struct display *d)
 {
@@ -366,3 +591,137 @@ pingServer(struct display *d)
     XSetIOErrorHandler(oldError);
     return True;
 }
+
+
+/*
+ * Have the kernel detect a vanished remote terminal. Returns True if
+ * keepalive probing could be enabled on the connection.
+ */
+static int
+setupKeepAlive(struct display *d, int fd)
+{
+#if defined(TCPCONN) && defined(SO_KEEPALIVE)
+    char buf[512];
+    socklen_t len = sizeof(buf);
+    int on = 1;
+# if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    int idle, intvl, cnt = 3;
+# endif
+
+    if (d->keepAliveTimeout <= 0 ||
+        getsockname(fd, (struct sockaddr *)buf, &len) ||
+        (((struct sockaddr *)buf)->sa_family != AF_INET
+# if defined(IPv6) && defined(AF_INET6)
+         && ((struct sockaddr *)buf)->sa_family != AF_INET6
+# endif
+        ))
+        return False;
+    if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on)))
+        return False;
+# if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    if ((intvl = d->keepAliveTimeout / (2 * cnt)) < 1)
+        intvl = 1;
+    if ((idle = d->keepAliveTimeout - intvl * cnt) < 1)
+        idle = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, (void *)&idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, (void *)&intvl, sizeof(intvl));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, (void *)&cnt, sizeof(cnt));
+# endif
+# ifdef TCP_USER_TIMEOUT
+    /* keepalives do not cover connections with unacknowledged data */
+    on = d->keepAliveTimeout * 1000;
+    setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, (void *)&on, sizeof(on));
+# endif
+    debug("keepalive timeout for %s is %d s\n", d->name, d->keepAliveTimeout);
+    return True;
+#else
+    return False;
+#endif
+}
+
+static int cldFds[2];
+
+/* ARGSUSED */
+static void
+cldNotify(int n ATTR_UNUSED)
+{
+    int olderrno = errno;
+    char buf = 0;
+    write(cldFds[1], &buf, 1);
+    errno = olderrno;
+}
+
+/*
+ * Wait for the process *pid to exit while watching the connection to
+ * the X server. A hang-up or error on the socket is noticed right away;
+ * a connection which cannot be supervised by the kernel is pinged every
+ * PingInterval minutes instead. Returns False if the server went away.
+ */
+int
+watchServer(struct display *d, volatile int *pid)
+{
+    SIGFUNC oldSig;
+    struct timeval tv, *tvp;
+    fd_set reads;
+    XEvent ev;
+    char buf;
+    int fd, nready, ret, result;
+
+    if (pipe(cldFds)) {
+        logError("Cannot create pipe: %m\n");
+        return True;
+    }
+    fcntl(cldFds[0], F_SETFL, fcntl(cldFds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(cldFds[1], F_SETFL, fcntl(cldFds[1], F_GETFL) | O_NONBLOCK);
+    oldSig = Signal(SIGCHLD, cldNotify);
+
+    fd = ConnectionNumber(dpy);
+    tvp = (setupKeepAlive(d, fd) || !d->pingInterval) ? 0 : &tv;
+    for (;;) {
+        if ((ret = waitpid(*pid, &result, WNOHANG))) {
+            if (ret < 0)
+                debug("waitpid(%d) failed: %m\n", *pid);
+            *pid = 0;
+            ret = True;
+            break;
+        }
+        FD_ZERO(&reads);
+        FD_SET(fd, &reads);
+        FD_SET(cldFds[0], &reads);
+        tv.tv_sec = d->pingInterval * 60;
+        tv.tv_usec = 0;
+        nready = select((fd > cldFds[0] ? fd : cldFds[0]) + 1,
+                        &reads, 0, 0, tvp);
+        if (nready < 0) {
+            if (errno != EINTR)
+                logError("select() failed: %m\n");
+            continue;
+        }
+        if (!nready) {
+            if (!pingServer(d)) {
+                ret = False;
+                break;
+            }
+            continue;
+        }
+        if (FD_ISSET(cldFds[0], &reads))
+            while (read(cldFds[0], &buf, 1) > 0);
+        if (FD_ISSET(fd, &reads)) {
+            if (!(nready = recv(fd, &buf, 1, MSG_PEEK)) ||
+                (nready < 0 && errno != EINTR && errno != EAGAIN))
+            {
+                debug("X server connection lost: %m\n");
+                ret = False;
+                break;
+            }
+            /* nobody selected any input, but be safe */
+            while (XPending(dpy))
+                XNextEvent(dpy, &ev);
+        }
+    }
+
+    (void)Signal(SIGCHLD, oldSig);
+    close(cldFds[0]);
+    close(cldFds[1]);
+    return ret;
+}
@@ -56,15 +56,6 @@ static void setupDisplay(const char *arg);
 static char **dupEnv(void);
 
 
-static Jmp_buf pingTime;
-
-/* ARGSUSED */
-static void
-catchAlrm(int n ATTR_UNUSED)
-{
-    Longjmp(pingTime, 1);
-}
-
 static Jmp_buf tenaciousClient;
 
 /* ARGSUSED */
@@ -243,9 +234,11 @@ ctrlGreeterWait(int wreply, time_t *startTime)
 #endif
 
     while (gRecvCmd(&cmd)) {
+        trace(TR_GreeterMsg, td->name, cmd);
         switch (cmd) {
         case G_Ready:
             debug("G_Ready\n");
+            trace(TR_GreeterReady, td->name, 0);
             return 0;
         case G_Interact:
             if (startTime)
@@ -336,6 +329,15 @@ ctrlGreeterWait(int wreply, time_t *startTime)
                 debug(" => keeping old\n");
             }
             break;
+        case G_PrefetchDmrc:
+            debug("G_PrefetchDmrc\n");
+            for (i = gRecvInt(); --i >= 0;) {
+                name = gRecvStr();
+                debug(" user %\"s\n", name);
+                prefetchDmrc(name);
+                free(name);
+            }
+            break;
         case G_GetDmrc:
             debug("G_GetDmrc\n");
             name = gRecvStr();
@@ -440,6 +442,7 @@ openGreeter()
     if (gOpen(&grtproc, (char **)0, "kdm_greet", env, name,
               greeterUID, td->greeterAuthFile, &td->gpipe))
         sessionExit(EX_UNMANAGE_DPY);
+    trace(TR_GreeterStart, td->name, grtproc.pid);
     freeStrArr(env);
     if ((cmd = ctrlGreeterWait(True, 0))) {
         logError("Received unknown or unexpected command %d from greeter\n", cmd);
@@ -449,6 +452,19 @@ openGreeter()
     debug("%s ready\n", name);
 }
 
+/* Tell the master daemon about a latency measurement. */
+void
+reportStat(int stat, unsigned long msecs)
+{
+    GTalk *otalk = gGet();
+
+    gSet(&mstrtalk);
+    gSendInt(D_Stat);
+    gSendInt(stat);
+    gSendInt((int)msecs);
+    gSet(otalk);
+}
+
 int
 closeGreeter(int force)
 {
@@ -459,6 +475,7 @@ closeGreeter(int force)
 
     ret = gClose(&grtproc, 0, force);
     debug("greeter for %s stopped\n", td->name);
+    endDmrcHelper();
     if (wcCode(ret) > EX_NORMAL && wcCode(ret) <= EX_MAX) {
         debug("greeter-initiated session exit, code %d\n", wcCode(ret));
         sessionExit(wcCode(ret));
@@ -549,6 +566,7 @@ manageSession(void)
     int ex, cmd;
     volatile int clientPid = -1;
     time_t tdiff, startt;
+    unsigned long msecs;
 
     debug("manageSession %s\n", td->name);
     if ((ex = Setjmp(abortSession))) {
@@ -587,7 +605,9 @@ manageSession(void)
     } else {
       regreet:
         startt = now;
+        msecs = nowMsecs();
         openGreeter();
+        reportStat(ST_Greeter, nowMsecs() - msecs);
 #ifdef XDMCP
         if (((td->displayType & d_location) == dLocal) &&
                 td->loginMode >= LOGIN_DEFAULT_REMOTE)
@@ -627,28 +647,24 @@ manageSession(void)
         setupDisplay(td_setup);
 
     blockTerm();
+    msecs = nowMsecs();
     if (!startClient(&clientPid)) {
         logError("Client start failed\n");
         sessionExit(EX_NORMAL); /* XXX maybe EX_REMANAGE_DPY? -- enable in dm.c! */
     }
+    reportStat(ST_Session, nowMsecs() - msecs);
     debug("client Started\n");
+    trace(TR_SessionStart, td->name, clientPid);
     unblockTerm();
 
     /*
      * Wait for session to end,
      */
-    for (;;) {
-        if (!Setjmp(pingTime)) {
-            (void)Signal(SIGALRM, catchAlrm);
-            (void)alarm(td->pingInterval * 60); /* may be 0 */
-            (void)Wait4(&clientPid);
-            (void)alarm(0);
-            break;
-        } else {
-            (void)alarm(0);
-            if (!pingServer(td))
-                catchTerm(SIGTERM);
-        }
+    if (!watchServer(td, &clientPid)) {
+        logError("X server for display %s went away\n", td->name);
+        gSet(&mstrtalk);
+        gSendInt(D_XConnLost);
+        catchTerm(SIGTERM);
     }
     /*
      * Sometimes the Xsession somehow manages to exit before
@@ -112,60 +112,63 @@ writeOut(int fd, const void *buf, size_t len, const char *msg)
             errno = -ENOSPC;
         logError(msg);
     }
+}
+
+static void
+closeOut(int fd, const char *msg)
+{
     if (close(fd) < 0)
         logError(msg);
 }
 #endif
 
-void
-sessreg(struct display *d, int pid, const char *user, int uid)
+/*
+ * The master daemon collects the records and writes them in batches:
+ * when it is idle, when the queue is full, and at the latest a second
+ * after the first record was queued.
+ */
+#define SESSREG_BATCH 64
+
+typedef struct {
+    STRUCTUTMP ut;
+    int login;
+    int uid;
+} SessRegEnt;
+
+static SessRegEnt sessregQueue[SESSREG_BATCH];
+static int sessregLen;
+static Timer sessregTimer;
+
+static int
+fillEntry(struct display *d, int pid, const char *user, STRUCTUTMP *ut)
 {
     const char *dot, *colon;
-    int left, clen, c;
-#ifdef BSD_UTMP
-    FILE *ttys;
-    int utmp, slot, freeslot;
-    STRUCTUTMP entry;
-#else
+    int left, clen;
+#ifndef BSD_UTMP
     unsigned crc, i;
+    int c;
 #endif
-#ifndef HAVE_UPDWTMP
-    int wtmp;
-#endif
-#ifndef NO_LASTLOG
-# ifdef HAVE_LASTLOGX
-    struct lastlogx ll;
-#  define ll_time ll_tv.tv_sec
-# else
-    int llog;
-    struct lastlog ll;
-# endif
-#endif
-    STRUCTUTMP ut_ent;
 
-    if (!d->useSessReg)
-        return;
-
-    bzero(&ut_ent, sizeof(ut_ent));
+    bzero(ut, sizeof(*ut));
 
     if (pid) {
-        strncpy(ut_ent.ut_user, user, sizeof(ut_ent.ut_user));
+        strncpy(ut->ut_user, user, sizeof(ut->ut_user));
 #ifndef BSD_UTMP
-        ut_ent.ut_pid = pid;
-        ut_ent.ut_type = USER_PROCESS;
+        ut->ut_pid = pid;
+        ut->ut_type = USER_PROCESS;
     } else {
-        ut_ent.ut_type = DEAD_PROCESS;
+        ut->ut_type = DEAD_PROCESS;
 #endif
     }
-    ut_ent.ut_time = time(0);
+    ut->ut_time = time(0);
 
     colon = strchr(d->name, ':');
     clen = strlen(colon);
-    if (clen > (int)(sizeof(ut_ent.ut_line) - UTL_OFF) - 2)
-        return; /* uhm, well ... */
+    if (clen > (int)(sizeof(ut->ut_line) - UTL_OFF) - 2)
+        return False; /* uhm, well ... */
     if (colon == d->name) {
 #ifndef BSD_UTMP
-        strncpy(ut_ent.ut_id, d->name, sizeof(ut_ent.ut_id));
+        strncpy(ut->ut_id, d->name, sizeof(ut->ut_id));
 #endif
         left = 0;
     } else {
@@ -174,28 +177,28 @@ sessreg(struct display *d, int pid, const char *user, int uid)
         if (pid)
 # endif
         {
-            if (colon - d->name > (int)sizeof(ut_ent.ut_host)) {
-                ut_ent.ut_host[0] = '~';
-                memcpy(ut_ent.ut_host + 1,
-                       colon - (sizeof(ut_ent.ut_host) - 1),
-                       sizeof(ut_ent.ut_host) - 1);
+            if (colon - d->name > (int)sizeof(ut->ut_host)) {
+                ut->ut_host[0] = '~';
+                memcpy(ut->ut_host + 1,
+                       colon - (sizeof(ut->ut_host) - 1),
+                       sizeof(ut->ut_host) - 1);
             } else {
-                memcpy(ut_ent.ut_host, d->name, colon - d->name);
+                memcpy(ut->ut_host, d->name, colon - d->name);
             }
         }
 #endif
 #ifndef BSD_UTMP
         crc = crc32s(d->name);
-        ut_ent.ut_id[0] = crc % 26 + 'A';
+        ut->ut_id[0] = crc % 26 + 'A';
         crc /= 26;
-        for (i = 1; i < sizeof(ut_ent.ut_id); i++) {
+        for (i = 1; i < sizeof(ut->ut_id); i++) {
             c = crc % 62;
             crc /= 62;
-            ut_ent.ut_id[i] = c < 26 ? c + 'A' :
-                              c < 52 ? c - 26 + 'a' : c - 52 + '0';
+            ut->ut_id[i] = c < 26 ? c + 'A' :
+                           c < 52 ? c - 26 + 'a' : c - 52 + '0';
         }
 #endif
-        left = sizeof(ut_ent.ut_line) - UTL_OFF - clen;
+        left = sizeof(ut->ut_line) - UTL_OFF - clen;
         if (colon - d->name <= left) {
             clen += colon - d->name;
             colon = d->name;
@@ -203,136 +206,217 @@ sessreg(struct display *d, int pid, const char *user, int uid)
         } else {
             dot = strchr(d->name, '.');
             if (dot && dot - d->name < left) {
-                memcpy(ut_ent.ut_line + UTL_OFF, d->name, left - 1);
-                ut_ent.ut_line[UTL_OFF + left - 1] = '~';
+                memcpy(ut->ut_line + UTL_OFF, d->name, left - 1);
+                ut->ut_line[UTL_OFF + left - 1] = '~';
             } else {
-                memcpy(ut_ent.ut_line + UTL_OFF, d->name, left / 2 - 1);
-                ut_ent.ut_line[UTL_OFF + left/2 - 1] = '~';
+                memcpy(ut->ut_line + UTL_OFF, d->name, left / 2 - 1);
+                ut->ut_line[UTL_OFF + left/2 - 1] = '~';
                 if (dot) {
-                    memcpy(ut_ent.ut_line + UTL_OFF + left / 2,
+                    memcpy(ut->ut_line + UTL_OFF + left / 2,
                            dot - (left - left / 2 - 1),
                            left - left / 2 - 1);
-                    ut_ent.ut_line[UTL_OFF + left - 1] = '~';
+                    ut->ut_line[UTL_OFF + left - 1] = '~';
                 } else
-                    memcpy(ut_ent.ut_line + UTL_OFF + left / 2,
+                    memcpy(ut->ut_line + UTL_OFF + left / 2,
                            colon - (left - left / 2), left - left / 2);
             }
         }
     }
 #ifdef UTL_PFX
-    memcpy(ut_ent.ut_line, UTL_PFX, UTL_OFF);
+    memcpy(ut->ut_line, UTL_PFX, UTL_OFF);
 #endif
-    memcpy(ut_ent.ut_line + UTL_OFF + left, colon, clen);
+    memcpy(ut->ut_line + UTL_OFF + left, colon, clen);
+    return True;
+}
+
+static void
+sessregTimeout(void *arg ATTR_UNUSED)
+{
+    flushSessreg();
+}
+
+/* Queue a login (pid != 0) or logout record for the display. */
+void
+sessreg(struct display *d, int pid, const char *user, int uid)
+{
+    SessRegEnt *se;
+
+    if (!d->useSessReg)
+        return;
+    if (sessregLen == SESSREG_BATCH)
+        flushSessreg();
+    se = &sessregQueue[sessregLen];
+    if (!fillEntry(d, pid, user, &se->ut))
+        return;
+    se->login = pid != 0;
+    se->uid = uid;
+    if (!sessregLen++) {
+        if (!sessregTimer.func)
+            initTimer(&sessregTimer, sessregTimeout, 0);
+        armTimer(&sessregTimer, now + 1);
+    }
+}
+
+int
+pendingSessreg(void)
+{
+    return sessregLen;
+}
+
+void
+flushSessreg(void)
+{
+    SessRegEnt *se;
+    int n;
+#ifdef BSD_UTMP
+    FILE *ttys;
+    int c, utmp, slot, baseslot, freeslot;
+    STRUCTUTMP entry;
+#endif
+#ifndef HAVE_UPDWTMP
+    int wtmp;
+    STRUCTUTMP wbuf[SESSREG_BATCH];
+#endif
+#ifndef NO_LASTLOG
+# ifdef HAVE_LASTLOGX
+    struct lastlogx ll;
+#  define ll_time ll_tv.tv_sec
+# else
+    int llog;
+    struct lastlog ll;
+# endif
+#endif
+
+    if (!sessregLen)
+        return;
+    cancelTimer(&sessregTimer);
+    debug("writing %d session records\n", sessregLen);
 
 #ifndef NO_UTMP
 # ifdef BSD_UTMP
     if ((utmp = open(UTMP_FILE, O_RDWR)) < 0) {
         debug("cannot open utmp file " UTMP_FILE ": %m\n");
     } else {
-
-        slot = 1;
-        if (pid) {
-            if (!(ttys = fopen(TTYS_FILE, "r"))) {
-                logWarn("Cannot open tty file " TTYS_FILE ": %m\n");
-            } else {
-                int column0 = True;
-                while ((c = getc(ttys)) != EOF)
-                    if (c == '\n') {
-                        slot++;
-                        column0 = True;
-                    } else {
-                        column0 = False;
-                    }
-                if (!column0)
-                    slot++;
-                fclose(ttys);
-            }
+        baseslot = 1;
+        if (!(ttys = fopen(TTYS_FILE, "r"))) {
+            logWarn("Cannot open tty file " TTYS_FILE ": %m\n");
+        } else {
+            int column0 = True;
+            while ((c = getc(ttys)) != EOF)
+                if (c == '\n') {
+                    baseslot++;
+                    column0 = True;
+                } else {
+                    column0 = False;
+                }
+            if (!column0)
+                baseslot++;
+            fclose(ttys);
         }
-        freeslot = -1;
-        lseek(utmp, slot * sizeof(entry), SEEK_SET);
-        while (read(utmp, (char *)&entry, sizeof(entry)) == sizeof(entry)) {
-            if (!strncmp(entry.ut_line, ut_ent.ut_line,
-                         sizeof(entry.ut_line)))
+        for (se = sessregQueue, n = sessregLen; n; se++, n--) {
+            slot = se->login ? baseslot : 1;
+            freeslot = -1;
+            lseek(utmp, slot * sizeof(entry), SEEK_SET);
+            while (read(utmp, (char *)&entry, sizeof(entry)) == sizeof(entry)) {
+                if (!strncmp(entry.ut_line, se->ut.ut_line,
+                             sizeof(entry.ut_line)))
 #  ifdef HAVE_STRUCT_UTMP_UT_HOST
-                if (!strncmp(entry.ut_host, ut_ent.ut_host,
-                             sizeof(entry.ut_host)))
+                    if (!strncmp(entry.ut_host, se->ut.ut_host,
+                                 sizeof(entry.ut_host)))
 #  endif
-                    goto found;
-            if (freeslot < 0 && *entry.ut_user == '\0')
-                freeslot = slot;
-            slot++;
-        }
-        if (!pid) {
-            debug("utmp entry for display %s vanished\n", d->name);
-            close(utmp);
-            goto skip;
-        }
-        if (freeslot >= 0)
-            slot = freeslot;
-      found:
+                        goto found;
+                if (freeslot < 0 && *entry.ut_user == '\0')
+                    freeslot = slot;
+                slot++;
+            }
+            if (!se->login) {
+                debug("utmp entry for %.*s vanished\n",
+                      (int)sizeof(se->ut.ut_line), se->ut.ut_line);
+                continue;
+            }
+            if (freeslot >= 0)
+                slot = freeslot;
+          found:
 
 #  ifdef HAVE_STRUCT_UTMP_UT_HOST
-        if (!pid)
-            bzero(ut_ent.ut_host, sizeof(ut_ent.ut_host));
+            if (!se->login)
+                bzero(se->ut.ut_host, sizeof(se->ut.ut_host));
 #  endif
-        lseek(utmp, slot * sizeof(ut_ent), SEEK_SET);
-        writeOut(utmp, &ut_ent, sizeof(ut_ent),
-                 "Cannot write utmp file " UTMP_FILE ": %m\n");
+            lseek(utmp, slot * sizeof(se->ut), SEEK_SET);
+            writeOut(utmp, &se->ut, sizeof(se->ut),
+                     "Cannot write utmp file " UTMP_FILE ": %m\n");
+        }
+        closeOut(utmp, "Cannot write utmp file " UTMP_FILE ": %m\n");
     }
-  skip:
 # else
     SETUTENT();
-    PUTUTLINE(&ut_ent); /* Returns void on some systems => no error check. */
+    for (se = sessregQueue, n = sessregLen; n; se++, n--)
+        PUTUTLINE(&se->ut); /* Returns void on some systems => no error check. */
     ENDUTENT();
 # endif
 #endif
 
 #ifdef HAVE_UPDWTMP
+    /* The library appends (and locks) record by record. */
+    for (se = sessregQueue, n = sessregLen; n; se++, n--)
 # ifdef HAVE_UTMPX
-    updwtmpx(WTMP_FILE, &ut_ent);
+        updwtmpx(WTMP_FILE, &se->ut);
 # else
-    updwtmp(WTMP_FILE, &ut_ent);
+        updwtmp(WTMP_FILE, &se->ut);
 # endif
 #else
-    if ((wtmp = open(WTMP_FILE, O_WRONLY | O_APPEND)) < 0)
+    if ((wtmp = open(WTMP_FILE, O_WRONLY | O_APPEND)) < 0) {
         debug("cannot open wtmp file " WTMP_FILE ": %m\n");
-    else
-        writeOut(wtmp, &ut_ent, sizeof(ut_ent),
+    } else {
+        for (n = 0; n < sessregLen; n++)
+            wbuf[n] = sessregQueue[n].ut;
+        writeOut(wtmp, wbuf, sessregLen * sizeof(wbuf[0]),
                  "Cannot write wtmp file " WTMP_FILE ": %m\n");
+        closeOut(wtmp, "Cannot write wtmp file " WTMP_FILE ": %m\n");
+    }
 #endif
 
 #ifndef NO_LASTLOG
-    if (pid) {
+# ifndef HAVE_LASTLOGX
+    llog = -1;
+# endif
+    for (se = sessregQueue, n = sessregLen; n; se++, n--) {
+        if (!se->login)
+            continue;
         bzero((char *)&ll, sizeof(ll));
-        ll.ll_time = ut_ent.ut_time;
-        memcpy(ll.ll_line, ut_ent.ut_line, sizeof(ll.ll_line));
-        memcpy(ll.ll_host, ut_ent.ut_host, sizeof(ll.ll_host));
+        ll.ll_time = se->ut.ut_time;
+        memcpy(ll.ll_line, se->ut.ut_line, sizeof(ll.ll_line));
+        memcpy(ll.ll_host, se->ut.ut_host, sizeof(ll.ll_host));
 # ifdef HAVE_LASTLOGX
-        updlastlogx(LLOG_FILE, uid, &ll);
+        updlastlogx(LLOG_FILE, se->uid, &ll);
 # else
-        if ((llog = open(LLOG_FILE, O_RDWR)) < 0) {
+        if (llog < 0 && (llog = open(LLOG_FILE, O_RDWR)) < 0) {
             debug("cannot open lastlog file " LLOG_FILE ": %m\n");
-        } else {
-            lseek(llog, (off_t)uid * sizeof(ll), SEEK_SET);
-            writeOut(llog, &ll, sizeof(ll),
-                     "Cannot write lastlog file " LLOG_FILE ": %m\n");
+            break;
         }
+        lseek(llog, (off_t)se->uid * sizeof(ll), SEEK_SET);
+        writeOut(llog, &ll, sizeof(ll),
+                 "Cannot write lastlog file " LLOG_FILE ": %m\n");
 # endif
     }
-#else
-    (void)uid;
+# ifndef HAVE_LASTLOGX
+    if (llog >= 0)
+        closeOut(llog, "Cannot write lastlog file " LLOG_FILE ": %m\n");
+# endif
 #endif
 
 #ifdef UTL_PFX
-    {
-        char tmp[sizeof("/dev/") + sizeof(ut_ent.ut_line)];
+    for (se = sessregQueue, n = sessregLen; n; se++, n--) {
+        char tmp[sizeof("/dev/") + sizeof(se->ut.ut_line)];
         mkdir("/dev/" UTL_PFX, 0755);
         chmod("/dev/" UTL_PFX, 0755);
-        sprintf(tmp, "/dev/%.*s", sizeof(ut_ent.ut_line), ut_ent.ut_line);
-        if (pid)
+        sprintf(tmp, "/dev/%.*s", sizeof(se->ut.ut_line), se->ut.ut_line);
+        if (se->login)
             close(creat(tmp, 0644));
         else
             unlink(tmp);
     }
 #endif
+
+    sessregLen = 0;
 }
@@ -0,0 +1,210 @@
+/*
+
+Copyright 2026 The kdm5 contributors
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of a copyright holder shall
+not be used in advertising or otherwise to promote the sale, use or
+other dealings in this Software without prior written authorization
+from the copyright holder.
+
+*/
+
+/*
+ * xdm - display manager daemon
+ *
+ * hierarchical timer wheel for the master daemon's timeouts
+ *
+ * The resolution is one second, the unit of "now". Level 0 has one slot
+ * per second; each further level has slots TW_SIZE times as wide. When
+ * the level 0 index wraps around, the current slot of the next level is
+ * cascaded down, so every timer is moved at most TW_LEVELS - 1 times.
+ * Timers beyond the range of the wheel are parked in the top level and
+ * re-sorted each time they are cascaded.
+ */
+
+#include "dm.h"
+#include "dm_error.h"
+
+#define TW_BITS 6
+#define TW_SIZE (1 << TW_BITS)
+#define TW_MASK (TW_SIZE - 1)
+#define TW_LEVELS 4
+
+static Timer *wheel[TW_LEVELS][TW_SIZE];
+static int wheelCount[TW_LEVELS];
+static Timer *dueTimers; /* armed for a time which has already been run */
+static time_t wheelTime; /* next second to be run */
+static int numTimers;
+
+static void
+linkTimer(Timer *t, Timer **head)
+{
+    if ((t->next = *head))
+        t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+}
+
+static void
+placeTimer(Timer *t)
+{
+    time_t delta = t->expires - wheelTime;
+    int l;
+
+    if (delta < 0) {
+        t->level = -1;
+        linkTimer(t, &dueTimers);
+        return;
+    }
+    for (l = 0; l < TW_LEVELS - 1; l++)
+        if (delta < (time_t)1 << (TW_BITS * (l + 1)))
+            break;
+    t->level = l;
+    wheelCount[l]++;
+    if (delta >= (time_t)1 << (TW_BITS * TW_LEVELS))
+        /* out of range; park it in the slot which is cascaded last */
+        linkTimer(t, &wheel[l][((wheelTime - 1) >> (TW_BITS * l)) & TW_MASK]);
+    else
+        linkTimer(t, &wheel[l][(t->expires >> (TW_BITS * l)) & TW_MASK]);
+}
+
+static void
+unlinkTimer(Timer *t)
+{
+    if ((*t->pprev = t->next))
+        t->next->pprev = t->pprev;
+    t->pprev = 0;
+    if (t->level >= 0)
+        wheelCount[t->level]--;
+}
+
+void
+initTimer(Timer *t, TimerFunc func, void *arg)
+{
+    t->pprev = 0;
+    t->func = func;
+    t->arg = arg;
+}
+
+void
+armTimer(Timer *t, time_t expires)
+{
+    if (!wheelTime)
+        wheelTime = now;
+    if (t->pprev)
+        unlinkTimer(t);
+    else
+        numTimers++;
+    t->expires = expires;
+    placeTimer(t);
+}
+
+void
+cancelTimer(Timer *t)
+{
+    if (t->pprev) {
+        unlinkTimer(t);
+        numTimers--;
+    }
+}
+
+int
+pendingTimers(void)
+{
+    return numTimers;
+}
+
+static void
+cascadeTimers(int l)
+{
+    Timer *t, **slot = &wheel[l][(wheelTime >> (TW_BITS * l)) & TW_MASK];
+
+    while ((t = *slot)) {
+        unlinkTimer(t);
+        placeTimer(t);
+    }
+}
+
+static void
+fireTimer(Timer *t)
+{
+    unlinkTimer(t);
+    numTimers--;
+    t->func(t->arg);
+}
+
+/*
+ * Run the callbacks of all expired timers. A callback may arm and
+ * cancel timers, including its own.
+ * Returns the time by which runTimers() needs to be called again.
+ */
+time_t
+runTimers(void)
+{
+    time_t to;
+    Timer **slot;
+    int l, k;
+
+    for (;;) {
+        if (dueTimers) {
+            fireTimer(dueTimers);
+            continue;
+        }
+        if (wheelTime > now || !numTimers)
+            break;
+        for (l = 1; l < TW_LEVELS; l++) {
+            if (wheelTime & (((time_t)1 << (TW_BITS * l)) - 1))
+                break;
+            cascadeTimers(l);
+        }
+        slot = &wheel[0][wheelTime & TW_MASK];
+        if (*slot) {
+            while (*slot)
+                fireTimer(*slot);
+        } else if (!wheelCount[0] && (wheelTime & TW_MASK)) {
+            /* nothing until the next cascade; skip ahead */
+            to = (wheelTime | TW_MASK) + 1;
+            wheelTime = to <= now ? to : now + 1;
+            continue;
+        }
+        wheelTime++;
+    }
+    if (!numTimers) {
+        wheelTime = now + 1;
+        return TO_INF;
+    }
+
+    /* find the earliest expiry or cascade */
+    to = TO_INF;
+    for (l = 0; l < TW_LEVELS; l++) {
+        int sh = TW_BITS * l;
+        time_t step = (time_t)1 << sh;
+        time_t t = (wheelTime + step - 1) & ~(step - 1);
+
+        if (!wheelCount[l])
+            continue;
+        for (k = 0; k < TW_SIZE && t < to; k++, t += step)
+            if (wheel[l][(t >> sh) & TW_MASK]) {
+                to = t;
+                break;
+            }
+    }
+    return to;
+}
@@ -0,0 +1,153 @@
+/*
+
+Copyright 2026 The kdm5 contributors
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of a copyright holder shall
+not be used in advertising or otherwise to promote the sale, use or
+other dealings in this Software without prior written authorization
+from the copyright holder.
+
+*/
+
+/*
+ * xdm - display manager daemon
+ *
+ * always-on event trace
+ *
+ * The events are recorded in a fixed-size ring which is mapped shared
+ * before anything is forked, so the master daemon and all sub-daemons
+ * write into the same ring. Writers claim a slot with an atomic
+ * increment and publish it by storing its sequence number last; the
+ * reader skips slots which are being overwritten.
+ */
+
+#include "dm.h"
+#include "dm_error.h"
+
+#include <sys/mman.h>
+
+#ifndef MAP_ANON
+# define MAP_ANON MAP_ANONYMOUS
+#endif
+
+#define TRACE_SIZE 1024 /* must be a power of two */
+
+typedef struct {
+    volatile unsigned seq;      /* index + 1 of the event; 0 while written */
+    int event;
+    int pid;
+    unsigned long msecs;        /* since daemon start */
+    long arg;
+    char tag[20];
+} TraceEnt;
+
+typedef struct {
+    volatile unsigned head;     /* index of the next event */
+    TraceEnt ents[TRACE_SIZE];
+} TraceRing;
+
+static TraceRing *ring;
+static unsigned long traceStart;
+
+#ifdef __GNUC__
+# define fetchAndInc(p) __sync_fetch_and_add(p, 1)
+# define memBarrier() __sync_synchronize()
+#else
+# define fetchAndInc(p) ((*(p))++)
+# define memBarrier() do {} while (0)
+#endif
+
+static const char *traceNames[] = {
+    "fork", "exec", "exit", "server-start", "server-ready", "xconnect",
+    "greeter-start", "greeter-ready", "auth-start", "auth-end",
+    "session-start", "greeter-msg", "master-msg", "login-step"
+};
+
+void
+initTrace(void)
+{
+    void *mem;
+
+    traceStart = nowMsecs();
+    mem = mmap(0, sizeof(TraceRing), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANON, -1, 0);
+    if (mem == MAP_FAILED) {
+        logWarn("Cannot map trace buffer: %m\n");
+        return;
+    }
+    ring = mem;
+}
+
+void
+trace(int event, const char *tag, long arg)
+{
+    TraceEnt *te;
+    unsigned idx;
+
+    if (!ring)
+        return;
+    idx = fetchAndInc(&ring->head);
+    te = &ring->ents[idx & (TRACE_SIZE - 1)];
+    te->seq = 0;
+    memBarrier();
+    te->event = event;
+    te->pid = getpid();
+    te->msecs = nowMsecs() - traceStart;
+    te->arg = arg;
+    if (tag) {
+        strncpy(te->tag, tag, sizeof(te->tag) - 1);
+        te->tag[sizeof(te->tag) - 1] = 0;
+    } else {
+        te->tag[0] = 0;
+    }
+    memBarrier();
+    te->seq = idx + 1;
+}
+
+/*
+ * Write the last count (all if <= 0) events to fd, oldest first, as
+ * tab-prefixed "msecs,pid,event,tag,arg" records.
+ */
+void
+dumpTrace(int fd, int count)
+{
+    TraceEnt te;
+    unsigned idx, end;
+    char cbuf[128];
+
+    if (!ring)
+        return;
+    end = ring->head;
+    idx = end > TRACE_SIZE ? end - TRACE_SIZE : 0;
+    if (count > 0 && end - idx > (unsigned)count)
+        idx = end - count;
+    for (; idx != end; idx++) {
+        memcpy(&te, (void *)&ring->ents[idx & (TRACE_SIZE - 1)], sizeof(te));
+        memBarrier();
+        if (te.seq != idx + 1 ||
+            ring->ents[idx & (TRACE_SIZE - 1)].seq != idx + 1)
+            continue; /* not yet published or already overwritten */
+        te.tag[sizeof(te.tag) - 1] = 0;
+        if ((unsigned)te.event < as(traceNames))
+            writer(fd, cbuf, sprintf(cbuf, "\t%lu,%d,%s,%s,%ld",
+                                     te.msecs, te.pid, traceNames[te.event],
+                                     te.tag, te.arg));
+    }
+}
@@ -54,6 +54,10 @@ from the copyright holder.
 # include <sys/utsname.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
 #ifdef HAVE_VTS
 #  include <sys/ioctl.h>
 #  if defined(__linux__)
@@ -672,6 +676,32 @@ hexToBinary(char *out, const char *in)
 
 #undef atox
 
+void
+histAdd(Hist *h, unsigned long msecs)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS - 1 && msecs >= (1UL << i); i++);
+    h->buckets[i]++;
+    h->count++;
+    h->sum += msecs;
+    if (msecs > h->max)
+        h->max = msecs;
+}
+
+void
+histMerge(Hist *h, const Hist *o)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        h->buckets[i] += o->buckets[i];
+    h->count += o->count;
+    h->sum += o->sum;
+    if (o->max > h->max)
+        h->max = o->max;
+}
+
 #ifdef HAVE_VTS
 /* Get next free VT. Works only on virtual terminal devices */
 static int
@@ -695,38 +725,126 @@ getNextFreeVT(const char *tty)
 }
 #endif
 
-/* X -from ip6-addr does not work here, so i don't know whether this is needed.
-#define IP6_MAGIC
-*/
+/*
+ * The TTY sessions are kept in memory, so listing them does not cost
+ * a utmp scan. The cache is rebuilt only after utmp was changed - which
+ * inotify tells us where available; otherwise the file's mtime is checked.
+ * The X sessions come straight from the display list anyway.
+ */
+
+typedef struct {
+    STRUCTUTMP ut; /* must be first; see ttySessUid() */
+    int uid; /* -1 if unknown */
+} TTYSess;
+
+static TTYSess *ttySess;
+static int ttySessCount, ttySessAlloc;
+static int ttySessValid;
+static time_t ttySessBuilt, ttySessMTime;
+
+/* stale entries are otherwise noticed only when utmp changes */
+#define TTYSESS_MAXAGE 60
+
+#ifdef HAVE_SYS_INOTIFY_H
+static int utmpNotify = -1, utmpWatch = -1;
+
+static void
+watchUtmp(void)
+{
+    if (utmpNotify < 0 || utmpWatch >= 0)
+        return;
+    if ((utmpWatch = inotify_add_watch(utmpNotify, UTMP_FILE,
+                                       IN_MODIFY | IN_ATTRIB |
+                                       IN_DELETE_SELF | IN_MOVE_SELF)) < 0)
+        debug("cannot watch " UTMP_FILE ": %m\n");
+}
+#endif
 
 void
-listSessions(int flags, struct display *d, void *ctx,
-             void (*emitXSess)(struct display *, struct display *, void *),
-             void (*emitTTYSess)(STRUCTUTMP *, struct display *, void *))
+initTTYSessions(void)
 {
-    struct display *di;
-#ifdef IP6_MAGIC
-    int le, dot;
+#ifdef HAVE_SYS_INOTIFY_H
+    if ((utmpNotify = inotify_init()) < 0) {
+        debug("inotify_init failed: %m\n");
+        return;
+    }
+    fcntl(utmpNotify, F_SETFL, O_NONBLOCK);
+    registerInput(utmpNotify);
+    registerCloseOnFork(utmpNotify);
+    watchUtmp();
 #endif
+}
+
+int
+handleTTYSessions(fd_set *reads)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    char buf[sizeof(struct inotify_event) * 16];
+    struct inotify_event *ev;
+    int n, o;
+
+    if (utmpNotify < 0 || !FD_ISSET(utmpNotify, reads))
+        return False;
+    while ((n = read(utmpNotify, buf, sizeof(buf))) > 0)
+        for (o = 0; o < n; o += sizeof(*ev) + ev->len) {
+            ev = (struct inotify_event *)(buf + o);
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                if (utmpWatch >= 0 && !(ev->mask & IN_IGNORED))
+                    inotify_rm_watch(utmpNotify, utmpWatch);
+                utmpWatch = -1; /* re-added on the next rebuild */
+            }
+        }
+    ttySessValid = False;
+    return True;
+#else
+    (void)reads;
+    return False;
+#endif
+}
+
+static int
+ttySessCurrent(void)
+{
+    struct stat st;
+
+    if (!ttySessValid || now - ttySessBuilt >= TTYSESS_MAXAGE)
+        return False;
+#ifdef HAVE_SYS_INOTIFY_H
+    if (utmpWatch >= 0)
+        return True;
+#endif
+    /* the mtime has a resolution of one second, so a change made in the
+     * second of the last rebuild might be missed. */
+    return !stat(UTMP_FILE, &st) &&
+           st.st_mtime == ttySessMTime && st.st_mtime < ttySessBuilt;
+}
+
+static void
+rebuildTTYSessions(void)
+{
 #ifdef BSD_UTMP
     int fd;
     struct utmp ut[1];
 #else
     STRUCTUTMP *ut;
 #endif
+    struct passwd *pw;
+    struct stat st;
+    TTYSess *ts;
+    char user[sizeof(ut->ut_user) + 1];
+    int l;
 #ifdef HAVE_VTS
     int con_fvt;
     con_fvt = -2;
 #endif
 
-    for (di = displays; di; di = di->next)
-        if (((flags & lstRemote) || (di->displayType & d_location) == dLocal) &&
-            (di->status == remoteLogin ||
-             ((flags & lstPassive) ? di->status == running : di->userSess >= 0)))
-            emitXSess(di, d, ctx);
-
-    if (!(flags & lstTTY))
-        return;
+#ifdef HAVE_SYS_INOTIFY_H
+    watchUtmp();
+#endif
+    ttySessMTime = stat(UTMP_FILE, &st) ? 0 : st.st_mtime;
+    ttySessBuilt = now;
+    ttySessValid = True;
+    ttySessCount = 0;
 
 #ifdef BSD_UTMP
     if ((fd = open(UTMP_FILE, O_RDONLY)) < 0)
@@ -745,10 +863,7 @@ listSessions(int flags, struct display *d, void *ctx,
             if (ut->ut_pid <= 0 || (kill(ut->ut_pid, 0) < 0 && errno == ESRCH))
                 continue; /* ignore stale utmp entries */
 #endif
-            if (*ut->ut_host) { /* from remote or x */
-                if (!(flags & lstRemote))
-                    continue;
-            } else {
+            if (!*ut->ut_host) {
                 if (!*ut->ut_line)
                     continue;
                 /* hack around broken konsole which does not set ut_host. */
@@ -765,30 +880,23 @@ listSessions(int flags, struct display *d, void *ctx,
             }
             if (strNChrCnt(ut->ut_line, sizeof(ut->ut_line), ':'))
                 continue; /* x login */
-            switch (strNChrCnt(ut->ut_host, sizeof(ut->ut_host), ':')) {
-            case 1: /* x terminal */
-                continue;
-            default:
-#ifdef IP6_MAGIC
-                /* unknown - IPv6 makes things complicated */
-                le = strnlen(ut->ut_host, sizeof(ut->ut_host));
-                /* cut off screen number */
-                for (dot = le; ut->ut_host[--dot] != ':';)
-                    if (ut->ut_host[dot] == '.') {
-                        le = dot;
-                        break;
-                    }
-                for (di = displays; di; di = di->next)
-                    if (!memcmp(di->name, ut->ut_host, le) && !di->name[le])
-                        goto cont; /* x terminal */
-                break;
-              cont:
-                continue;
-            case 0: /* no x terminal */
-#endif
-                break;
+            if (strNChrCnt(ut->ut_host, sizeof(ut->ut_host), ':') == 1)
+                continue; /* x terminal */
+            if (ttySessCount == ttySessAlloc) {
+                ttySessAlloc = ttySessAlloc ? ttySessAlloc * 2 : 16;
+                if (!(ts = realloc(ttySess, ttySessAlloc * sizeof(*ts)))) {
+                    logOutOfMem();
+                    ttySessAlloc = ttySessCount;
+                    break;
+                }
+                ttySess = ts;
             }
-            emitTTYSess(ut, d, ctx);
+            ts = &ttySess[ttySessCount++];
+            ts->ut = *ut;
+            l = strnlen(ut->ut_user, sizeof(ut->ut_user));
+            memcpy(user, ut->ut_user, l);
+            user[l] = 0;
+            ts->uid = (pw = getpwnam(user)) ? (int)pw->pw_uid : -1;
         }
     }
 #ifdef BSD_UTMP
@@ -796,7 +904,67 @@ listSessions(int flags, struct display *d, void *ctx,
 #else
     ENDUTENT();
 #endif
-    endpwent(); /* The TTY callbacks use getpwnam(). */
+    endpwent();
+    debug("cached %d TTY sessions\n", ttySessCount);
+}
+
+/* Only valid for the utmp entries passed to listSessions' callbacks. */
+int
+ttySessUid(STRUCTUTMP *ut)
+{
+    return ((TTYSess *)ut)->uid;
+}
+
+/* X -from ip6-addr does not work here, so i don't know whether this is needed.
+#define IP6_MAGIC
+*/
+
+void
+listSessions(int flags, struct display *d, void *ctx,
+             void (*emitXSess)(struct display *, struct display *, void *),
+             void (*emitTTYSess)(STRUCTUTMP *, struct display *, void *))
+{
+    struct display *di;
+    STRUCTUTMP *ut;
+    int i;
+#ifdef IP6_MAGIC
+    int le, dot;
+#endif
+
+    for (di = displays; di; di = di->next)
+        if (((flags & lstRemote) || (di->displayType & d_location) == dLocal) &&
+            (di->status == remoteLogin ||
+             ((flags & lstPassive) ? di->status == running : di->userSess >= 0)))
+            emitXSess(di, d, ctx);
+
+    if (!(flags & lstTTY))
+        return;
+
+    if (!ttySessCurrent())
+        rebuildTTYSessions();
+    for (i = 0; i < ttySessCount; i++) {
+        ut = &ttySess[i].ut;
+        if (*ut->ut_host && !(flags & lstRemote))
+            continue; /* from remote or x */
+#ifdef IP6_MAGIC
+        if (strNChrCnt(ut->ut_host, sizeof(ut->ut_host), ':') > 1) {
+            /* unknown - IPv6 makes things complicated */
+            le = strnlen(ut->ut_host, sizeof(ut->ut_host));
+            /* cut off screen number */
+            for (dot = le; ut->ut_host[--dot] != ':';)
+                if (ut->ut_host[dot] == '.') {
+                    le = dot;
+                    break;
+                }
+            for (di = displays; di; di = di->next)
+                if (!memcmp(di->name, ut->ut_host, le) && !di->name[le])
+                    break;
+            if (di)
+                continue; /* x terminal */
+        }
+#endif
+        emitTTYSess(ut, d, ctx);
+    }
 }
 
 typedef struct {
@@ -818,10 +986,9 @@ static void
 noteTTYSession(STRUCTUTMP *ut, struct display *d, void *ctx)
 {
     AULData *dt = (AULData *)ctx;
-    struct passwd *pw;
     (void)d;
 
-    if (dt->uid < 0 || !(pw = getpwnam(ut->ut_user)) || (int)pw->pw_uid != dt->uid)
+    if (dt->uid < 0 || ttySessUid(ut) != dt->uid)
         dt->any = True;
 }
 
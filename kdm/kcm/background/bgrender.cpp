@@ -8,6 +8,7 @@
  * Public License. See the file "COPYING.LIB" for the exact licensing terms.
  */
 #include "bgrender.h"
+#include "bgscale.h"
 
 #include <fixx11h.h>
 #include <config-workspace.h>
@@ -29,6 +30,7 @@
 #include <QTemporaryFile>
 #include <QApplication>
 #include <QDebug>
+#include <QImageReader>
 
 #include <kconfig.h>
 #include <kconfiggroup.h>
@@ -66,6 +68,8 @@ KBackgroundRenderer::KBackgroundRenderer(int screen, bool drawBackgroundPerScree
     m_bPreview = false;
     m_Cached = false;
     m_TilingEnabled = false;
+    m_pPrerender = 0;
+    m_Prerendered.mode = NoWallpaper;
 
     m_pTimer = new QTimer(this);
     m_pTimer->setSingleShot(true);
@@ -78,6 +82,9 @@ KBackgroundRenderer::~KBackgroundRenderer()
     cleanup();
     delete m_Tempfile;
     m_Tempfile = 0;
+    if (m_pPrerender)
+        m_pPrerender->wait();
+    syncWallpaperState();
 }
 
 
@@ -264,6 +271,158 @@ int KBackgroundRenderer::doBackground(bool quit)
 }
 
 
+/*
+ * Decode a raster wallpaper right at the size it is going to be drawn
+ * at. The geometry is computed from the image header, so the decoder can
+ * scale (and for ScaleAndCrop, clip) while reading - JPEG does that
+ * natively - instead of materializing the full-resolution image first.
+ * Other formats are scaled with smoothScale() after reading; @p parallel
+ * is passed on to it.
+ */
+QImage KBackgroundRenderer::readWallpaper(const QString &file, int wpmode, const QSize &desktopSize,
+                                          const QSize &rSize, bool preview, bool parallel)
+{
+    QImageReader reader(file);
+    QSize size = reader.size();
+    if (!size.isValid())
+        return reader.read();
+
+    // desktop width/height
+    int w = desktopSize.width();
+    int h = desktopSize.height();
+
+    // the preview shows the wallpaper as it would look on the real desktop
+    QSize scaled = size;
+    if (preview) {
+        scaled = QSize(qMax(1, size.width() * w / rSize.width()),
+                       qMax(1, size.height() * h / rSize.height()));
+        if (scaled.width() == 1 || scaled.height() == 1)
+            scaled = QSize(1, 1);
+    }
+    int ww = scaled.width();
+    int wh = scaled.height();
+    QRect clip;
+
+    switch (wpmode) {
+    case Scaled:
+        ww = w;
+        wh = h;
+        break;
+    case CentredAutoFit:
+        if (ww <= w && wh <= h)
+            break;
+        // fall through
+    case CentredMaxpect:
+    case TiledMaxpect: {
+        double sx = (double) w / ww;
+        double sy = (double) h / wh;
+        if (sx > sy) {
+            ww = (int)(sy * ww);
+            wh = h;
+        } else {
+            wh = (int)(sx * wh);
+            ww = w;
+        }
+        break;
+    }
+    case ScaleAndCrop: {
+        // decode only the part which ends up on screen
+        double s = qMax((double) w / ww, (double) h / wh)
+                   * ww / size.width();
+        int cw = qMin(size.width(), qRound(w / s));
+        int ch = qMin(size.height(), qRound(h / s));
+        clip = QRect((size.width() - cw) / 2, (size.height() - ch) / 2, cw, ch);
+        ww = w;
+        wh = h;
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (ww < 1 || wh < 1)
+        return QImage();
+    if (clip.isValid())
+        reader.setClipRect(clip);
+    // decoders which cannot scale natively are left to our own scaler
+    if (QSize(ww, wh) != (clip.isValid() ? clip.size() : size) &&
+        reader.supportsOption(QImageIOHandler::ScaledSize))
+        reader.setScaledSize(QSize(ww, wh));
+    QImage img = reader.read();
+    if (!img.isNull() && img.size() != QSize(ww, wh))
+        img = smoothScale(img, QSize(ww, wh), parallel);
+    return img;
+}
+
+void KWallpaperPrerender::run()
+{
+    QImage img = KBackgroundRenderer::readWallpaper(m_Wallpaper.file, m_Wallpaper.mode,
+                                                    m_Wallpaper.size, m_Wallpaper.size, false,
+                                                    false); // we run at idle priority; stay on one core
+    if (!img.isNull())
+        img = img.convertToFormat(QImage::Format_ARGB32_Premultiplied, Qt::DiffuseAlphaDither);
+    m_Wallpaper.image = img;
+}
+
+/*
+ * In slideshow mode, decode the next wallpaper while the current one is
+ * shown. Only raster images are done; SVGs are rendered with QPainter,
+ * which must stay in the GUI thread.
+ */
+void KBackgroundRenderer::prerenderNextWallpaper()
+{
+    int wpmode = enabled() ? wallpaperMode() : NoWallpaper;
+    if (wpmode == NoWallpaper || m_bPreview || m_pPrerender)
+        return;
+    QString name = nextWallpaper();
+    if (name.isEmpty())
+        return;
+    QString file = m_pDirs->findResource("wallpaper", name);
+    if (file.isEmpty() || file.endsWith(".svg") || file.endsWith(".svgz"))
+        return;
+    if (m_Prerendered.file == file && m_Prerendered.mode == wpmode &&
+        m_Prerendered.size == m_Size)
+        return;
+
+    KPreparedWallpaper wp;
+    wp.file = file;
+    wp.mode = wpmode;
+    wp.size = m_Size;
+    m_Prerendered.file.clear();
+    m_Prerendered.image = QImage();
+    m_pPrerender = new KWallpaperPrerender(wp, this);
+    connect(m_pPrerender, SIGNAL(finished()), SLOT(prerenderDone()));
+    m_pPrerender->start(QThread::IdlePriority);
+}
+
+void KBackgroundRenderer::prerenderDone()
+{
+    if (!m_pPrerender || !m_pPrerender->isFinished())
+        return;
+    m_Prerendered = m_pPrerender->wallpaper();
+    m_pPrerender->deleteLater();
+    m_pPrerender = 0;
+}
+
+/*
+ * Hand out the prerendered wallpaper if it is the one asked for. A
+ * prerender which is still running is not waited for; at idle priority
+ * it may take arbitrarily long.
+ */
+QImage KBackgroundRenderer::takePrerendered(const QString &file, int wpmode)
+{
+    prerenderDone();
+    QImage img;
+    if (m_Prerendered.file == file && m_Prerendered.mode == wpmode &&
+        m_Prerendered.size == m_Size && !m_bPreview) {
+        img = m_Prerendered.image;
+        qDebug() << Q_FUNC_INFO << "Using prerendered wallpaper" << file;
+    }
+    m_Prerendered.file.clear();
+    m_Prerendered.image = QImage();
+    return img;
+}
+
 int KBackgroundRenderer::doWallpaper(bool quit)
 {
     if (m_State & WallpaperDone)
@@ -274,6 +433,7 @@ int KBackgroundRenderer::doWallpaper(bool quit)
         return Done;
 
     int wpmode = enabled() ? wallpaperMode() : NoWallpaper;
+    bool isSvg = false;
 
     m_Wallpaper = QImage();
     if (wpmode != NoWallpaper) {
@@ -293,7 +453,8 @@ wp_load:
         // _Don't_ use KMimeType, as it relies on ksycoca which we really
         // don't want in krootimage (kdm context).
         //if (KMimeType::findByPath(file)->is("image/svg+xml")) {
-        if (file.endsWith(".svg") || file.endsWith(".svgz")) {
+        isSvg = file.endsWith(".svg") || file.endsWith(".svgz");
+        if (isSvg) {
 
             // Special stuff for SVG icons
 
@@ -346,8 +507,11 @@ wp_load:
                 renderer.render(&p);
             }
         } else {
-            qDebug() << Q_FUNC_INFO << "Loading wallpaper" << file;
-            m_Wallpaper.load(file);
+            m_Wallpaper = takePrerendered(file, wpmode);
+            if (m_Wallpaper.isNull()) {
+                qDebug() << Q_FUNC_INFO << "Loading wallpaper" << file;
+                m_Wallpaper = readWallpaper(file, wpmode, m_Size, m_rSize, m_bPreview);
+            }
         }
         if (m_Wallpaper.isNull()) {
             qWarning() << Q_FUNC_INFO << "failed to load wallpaper " << file ;
@@ -360,15 +524,15 @@ wp_load:
         qDebug() << "wallpaper from" << file << ":" << m_Wallpaper;
 
         // If we're previewing, scale the wallpaper down to make the preview
-        // look more like the real desktop.
-        if (m_bPreview) {
+        // look more like the real desktop. readWallpaper() did that already.
+        if (m_bPreview && isSvg) {
             int xs = m_Wallpaper.width() * m_Size.width() / m_rSize.width();
             int ys = m_Wallpaper.height() * m_Size.height() / m_rSize.height();
             if ((xs < 1) || (ys < 1)) {
                 xs = ys = 1;
             }
             if (m_WallpaperRect.size() != QSize(xs, ys))
-                m_Wallpaper = m_Wallpaper.scaled(xs, ys, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+                m_Wallpaper = smoothScale(m_Wallpaper, QSize(xs, ys));
         }
 
 #if 0
@@ -451,8 +615,8 @@ wp_out:
     case Scaled:
         ww = w;
         wh = h;
-        if (m_WallpaperRect.size() != QSize(w, h))
-            m_Wallpaper = m_Wallpaper.scaled(w, h, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (m_Wallpaper.size() != QSize(w, h))
+            m_Wallpaper = smoothScale(m_Wallpaper, QSize(w, h));
         m_WallpaperRect.setRect(0, 0, w, h);
         break;
     case CentredAutoFit:
@@ -471,8 +635,8 @@ wp_out:
             wh = (int)(sx * wh);
             ww = w;
         }
-        if (m_WallpaperRect.size() != QSize(ww, wh))
-            m_Wallpaper = m_Wallpaper.scaled(ww, wh, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (m_Wallpaper.size() != QSize(ww, wh))
+            m_Wallpaper = smoothScale(m_Wallpaper, QSize(ww, wh));
         m_WallpaperRect.setRect((w - ww) / 2, (h - wh) / 2, ww, wh);
         break;
     }
@@ -486,8 +650,8 @@ wp_out:
             wh = (int)(sx * wh);
             ww = w;
         }
-        if (m_WallpaperRect.size() != QSize(ww, wh))
-            m_Wallpaper = m_Wallpaper.scaled(ww, wh, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (m_Wallpaper.size() != QSize(ww, wh))
+            m_Wallpaper = smoothScale(m_Wallpaper, QSize(ww, wh));
         m_WallpaperRect.setRect(0, 0, w, h);
         break;
     }
@@ -503,8 +667,8 @@ wp_out:
             wh = h;
             ww = (int)(sy * ww);
         }
-        if (m_WallpaperRect.size() != QSize(ww, wh))
-            m_Wallpaper = m_Wallpaper.scaled(ww, wh, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (m_Wallpaper.size() != QSize(ww, wh))
+            m_Wallpaper = smoothScale(m_Wallpaper, QSize(ww, wh));
         m_WallpaperRect.setRect((w - ww) / 2, (h - wh) / 2, w, h);
         break;
     }
@@ -808,6 +972,7 @@ void KBackgroundRenderer::done()
     } else if (backgroundMode() == Program) {
         emit programSuccess();
     }
+    prerenderNextWallpaper();
 }
 
 /*
@@ -14,6 +14,7 @@
 #include <QObject>
 #include <QPixmap>
 #include <QImage>
+#include <QThread>
 #include <KProcess>
 #include <ksharedconfig.h>
 
@@ -27,6 +28,39 @@ class QTimer;
 class QTemporaryFile;
 class KStandardDirs;
 
+/**
+ * A wallpaper decoded and scaled for a given mode and desktop size.
+ */
+struct KPreparedWallpaper {
+    QString file;
+    int mode;
+    QSize size;
+    QImage image;
+};
+
+/**
+ * Decodes the wallpaper which is going to be shown next in the background,
+ * so the next change only needs to blend it.
+ */
+class KWallpaperPrerender: public QThread {
+    Q_OBJECT
+
+public:
+    KWallpaperPrerender(const KPreparedWallpaper &wp, QObject *parent)
+        : QThread(parent), m_Wallpaper(wp) {}
+
+    /**
+     * @return the result; only valid once the thread has finished
+     */
+    const KPreparedWallpaper &wallpaper() const { return m_Wallpaper; }
+
+protected:
+    virtual void run();
+
+private:
+    KPreparedWallpaper m_Wallpaper;
+};
+
 /**
  * This class renders a desktop background to a QImage. The operation is
  * asynchronous: connect to the signal imageDone() to find out when the
@@ -54,6 +88,13 @@ public:
     void saveCacheFile();
     void enableTiling(bool enable) { m_TilingEnabled = enable; }
 
+    /**
+     * Decodes @p file scaled for @p wpmode on a desktop of @p desktopSize.
+     * Public for the benchmark; the renderer itself is not needed.
+     */
+    static QImage readWallpaper(const QString &file, int wpmode, const QSize &desktopSize,
+                                const QSize &rSize, bool preview, bool parallel = true);
+
 public Q_SLOTS:
     void start(bool enableBusyCursor = false);
     void stop();
@@ -68,6 +109,7 @@ private Q_SLOTS:
     void slotBackgroundDone(int exitCode, QProcess::ExitStatus exitStatus);
     void render();
     void done();
+    void prerenderDone();
 
 private:
     enum { Error, Wait, WaitUpdate, Done };
@@ -88,6 +130,8 @@ private:
 
     int doBackground(bool quit = false);
     int doWallpaper(bool quit = false);
+    void prerenderNextWallpaper();
+    QImage takePrerendered(const QString &file, int wpmode);
     void setBusyCursor(bool isBusy);
     QString cacheFileName();
     bool useCacheFile() const;
@@ -109,6 +153,11 @@ private:
 
     KStandardDirs *m_pDirs;
     KProcess *m_pProc;
+
+    KWallpaperPrerender *m_pPrerender;
+    KPreparedWallpaper m_Prerendered;
+
+    friend class KWallpaperPrerender;
 };
 
 #endif // BGRender_h_Included
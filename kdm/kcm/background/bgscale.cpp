@@ -0,0 +1,230 @@
+/* vi: ts=8 sts=4 sw=4
+ * kate: space-indent on; tab-width 8; indent-width 4; indent-mode cstyle;
+ *
+ * This file is part of the KDE project, module kdm.
+ *
+ * You can Freely distribute this program under the GNU Library General
+ * Public License. See the file "COPYING.LIB" for the exact licensing terms.
+ */
+
+#include "bgscale.h"
+
+#include <QGlobalStatic>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include <math.h>
+
+// the benchmark builds the plain C filter as well, to check against it
+#if defined(__SSE2__) && !defined(BGSCALE_NO_SIMD)
+#define BGSCALE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+// don't bother other threads for less than this
+#define MIN_BAND_ROWS 16
+#define MIN_PARALLEL_PIXELS (256 * 256)
+
+/*
+ * The filter taps for each destination column (or row). Every destination
+ * pixel has the same number of taps, so they can be stored in a flat
+ * array; unneeded ones have a weight of 0. The taps never reach beyond
+ * the source, so the inner loops need no bounds checks.
+ */
+struct Contribs {
+    int taps;
+    QVector<int> first;
+    QVector<short> weights;
+};
+
+static void
+calcContribs(Contribs &c, int src, int dst)
+{
+    double scale = (double)dst / src;
+    double radius = scale < 1 ? 1 / scale : 1;
+
+    c.taps = qMin(src, (int)ceil(radius * 2) + 1);
+    c.first.resize(dst);
+    c.weights.fill(0, dst * c.taps);
+    QVector<double> wt(c.taps);
+    for (int i = 0; i < dst; i++) {
+        double center = (i + 0.5) / scale - 0.5;
+        int lo = qMax(0, (int)floor(center - radius) + 1);
+        int hi = qMin(src - 1, (int)ceil(center + radius) - 1);
+        int first = qMin(lo, src - c.taps);
+        double sum = 0;
+        for (int j = lo; j <= hi; j++)
+            sum += (wt[j - first] = 1 - fabs(j - center) / radius);
+        short *w = c.weights.data() + i * c.taps;
+        int isum = 0, max = lo - first;
+        if (sum > 0) {
+            for (int j = lo; j <= hi; j++) {
+                isum += (w[j - first] = (short)(wt[j - first] / sum * WEIGHT_ONE + .5));
+                if (w[j - first] > w[max])
+                    max = j - first;
+            }
+        }
+        // the weights must add up exactly, so the result cannot overflow
+        w[max] += WEIGHT_ONE - isum;
+        c.first[i] = first;
+    }
+}
+
+/*
+ * Apply the taps to one pixel. p points to the first source pixel; the
+ * others are stride pixels apart.
+ */
+static inline quint32
+filterPixel(const quint32 *p, int stride, const short *w, int taps)
+{
+#ifdef BGSCALE_SSE2
+    // interleave the channels of two pixels, so madd applies two taps at once
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_set1_epi32(WEIGHT_ONE / 2);
+    int k = 0;
+    for (; k + 1 < taps; k += 2) {
+        __m128i a = _mm_cvtsi32_si128(p[k * stride]);
+        __m128i b = _mm_cvtsi32_si128(p[(k + 1) * stride]);
+        __m128i px = _mm_unpacklo_epi8(_mm_unpacklo_epi8(a, b), zero);
+        __m128i wt = _mm_set1_epi32((w[k + 1] << 16) | (quint16)w[k]);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(px, wt));
+    }
+    if (k < taps) {
+        __m128i a = _mm_cvtsi32_si128(p[k * stride]);
+        __m128i px = _mm_unpacklo_epi8(_mm_unpacklo_epi8(a, zero), zero);
+        __m128i wt = _mm_set1_epi32((quint16)w[k]);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(px, wt));
+    }
+    acc = _mm_srai_epi32(acc, WEIGHT_BITS);
+    acc = _mm_packs_epi32(acc, acc);
+    acc = _mm_packus_epi16(acc, acc);
+    return _mm_cvtsi128_si32(acc);
+#else
+    int a = WEIGHT_ONE / 2, r = a, g = a, b = a;
+    for (int k = 0; k < taps; k++) {
+        quint32 px = p[k * stride];
+        a += (px >> 24) * w[k];
+        r += ((px >> 16) & 0xff) * w[k];
+        g += ((px >> 8) & 0xff) * w[k];
+        b += (px & 0xff) * w[k];
+    }
+    return ((quint32)(a >> WEIGHT_BITS) << 24) | ((r >> WEIGHT_BITS) << 16) |
+           ((g >> WEIGHT_BITS) << 8) | (b >> WEIGHT_BITS);
+#endif
+}
+
+/*
+ * One resampling pass along one axis; all destination rows are computed.
+ * The destination is accessed through a raw pointer, as the non-const
+ * QImage::scanLine() must not be called from several threads.
+ */
+struct ScalePass {
+    const QImage *src;
+    uchar *dst;
+    int dstride, dw;
+    const Contribs *c;
+    bool vertical;
+
+    void run(int y0, int y1) const
+    {
+        int taps = c->taps;
+        for (int y = y0; y < y1; y++) {
+            quint32 *d = reinterpret_cast<quint32 *>(dst + y * dstride);
+            if (vertical) {
+                const quint32 *s = reinterpret_cast<const quint32 *>(
+                    src->constScanLine(c->first[y]));
+                const short *w = c->weights.constData() + y * taps;
+                int stride = src->bytesPerLine() / 4;
+                for (int x = 0; x < dw; x++)
+                    d[x] = filterPixel(s + x, stride, w, taps);
+            } else {
+                const quint32 *s = reinterpret_cast<const quint32 *>(
+                    src->constScanLine(y));
+                const short *w = c->weights.constData();
+                for (int x = 0; x < dw; x++, w += taps)
+                    d[x] = filterPixel(s + c->first[x], 1, w, taps);
+            }
+        }
+    }
+};
+
+class ScaleBand : public QRunnable {
+  public:
+    ScaleBand(const ScalePass *_pass, int _y0, int _y1, QSemaphore *_done)
+        : pass(_pass), y0(_y0), y1(_y1), done(_done) {}
+    virtual void run()
+    {
+        pass->run(y0, y1);
+        done->release();
+    }
+
+  private:
+    const ScalePass *pass;
+    int y0, y1;
+    QSemaphore *done;
+};
+
+// A pool of our own, so callers which run in the global pool cannot starve us.
+Q_GLOBAL_STATIC(QThreadPool, scalePool)
+
+static void
+runPass(const QImage &src, QImage &dst, const Contribs &c, bool vertical,
+        bool parallel)
+{
+    // bits() detaches if needed; do that here, before the workers start
+    ScalePass pass = { &src, dst.bits(), dst.bytesPerLine(), dst.width(),
+                       &c, vertical };
+    int rows = dst.height();
+    int bands = parallel ? qMin(QThread::idealThreadCount(), rows / MIN_BAND_ROWS) : 1;
+    if (bands <= 1 || dst.width() * rows < MIN_PARALLEL_PIXELS) {
+        pass.run(0, rows);
+        return;
+    }
+    QSemaphore done;
+    for (int i = 1; i < bands; i++)
+        scalePool()->start(new ScaleBand(&pass, rows * i / bands,
+                                         rows * (i + 1) / bands, &done));
+    pass.run(0, rows / bands);
+    done.acquire(bands - 1);
+}
+
+QImage
+smoothScale(const QImage &_src, const QSize &size, bool parallel)
+{
+    if (_src.isNull() || size.isEmpty())
+        return QImage();
+    QImage src = _src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    int sw = src.width(), sh = src.height();
+    int dw = size.width(), dh = size.height();
+    if (sw == dw && sh == dh)
+        return src;
+
+    Contribs hc, vc;
+    calcContribs(hc, sw, dw);
+    calcContribs(vc, sh, dh);
+
+    // do the pass which shrinks the intermediate image most first
+    bool vfirst = (double)dh * sw * vc.taps + (double)dh * dw * hc.taps <
+                  (double)sh * dw * hc.taps + (double)dh * dw * vc.taps;
+    QImage tmp = src;
+    if (vfirst ? sh != dh : sw != dw) {
+        tmp = vfirst ? QImage(sw, dh, QImage::Format_ARGB32_Premultiplied) :
+                       QImage(dw, sh, QImage::Format_ARGB32_Premultiplied);
+        if (tmp.isNull())
+            return QImage();
+        runPass(src, tmp, vfirst ? vc : hc, vfirst, parallel);
+    }
+    if (vfirst ? sw == dw : sh == dh)
+        return tmp;
+    QImage dst(dw, dh, QImage::Format_ARGB32_Premultiplied);
+    if (dst.isNull())
+        return QImage();
+    runPass(tmp, dst, vfirst ? hc : vc, !vfirst, parallel);
+    return dst;
+}
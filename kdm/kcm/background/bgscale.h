@@ -0,0 +1,27 @@
+/* vi: ts=8 sts=4 sw=4
+ * kate: space-indent on; tab-width 8; indent-width 4; indent-mode cstyle;
+ *
+ * This file is part of the KDE project, module kdm.
+ *
+ * You can Freely distribute this program under the GNU Library General
+ * Public License. See the file "COPYING.LIB" for the exact licensing terms.
+ */
+
+#ifndef BGScale_h_Included
+#define BGScale_h_Included
+
+#include <QImage>
+
+/**
+ * High quality replacement for QImage::scaled(..., Qt::SmoothTransformation)
+ * for screen-sized images.
+ *
+ * The image is resampled separably with a triangle filter, i.e. bilinearly
+ * when enlarging and area-weighted when shrinking. Each pass is split into
+ * bands of rows which are processed in parallel, unless @p parallel is
+ * false - background work should not compete with the foreground for the
+ * CPUs. The result is always ARGB32_Premultiplied.
+ */
+QImage smoothScale(const QImage &src, const QSize &size, bool parallel = true);
+
+#endif
@@ -0,0 +1,203 @@
+/* vi: ts=8 sts=4 sw=4
+ * kate: space-indent on; tab-width 8; indent-width 4; indent-mode cstyle;
+ *
+ * This file is part of the KDE project, module kdm.
+ *
+ * You can Freely distribute this program under the GNU Library General
+ * Public License. See the file "COPYING.LIB" for the exact licensing terms.
+ */
+
+/*
+ * Times smoothScale() against QImage::scaled(..., Qt::SmoothTransformation)
+ * at common screen sizes and checks that the SSE2 filter computes exactly
+ * the same pixels as the plain C one. Exits with 1 if they differ.
+ *
+ * Given image files instead, it measures the time and the peak memory
+ * KBackgroundRenderer::readWallpaper() needs for them in each wallpaper
+ * mode.
+ */
+
+#include "bgscale.h"
+#include "bgrender.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define RUNS 5
+
+// bgscalebench_scalar.cpp
+QImage smoothScaleScalar(const QImage &src, const QSize &size, bool parallel);
+
+static QImage
+makeSource(const QSize &size)
+{
+    // noise over a gradient, so there are both smooth areas and sharp edges
+    QImage img(size, QImage::Format_ARGB32_Premultiplied);
+    int w = size.width(), h = size.height();
+    quint32 seed = 1;
+    for (int y = 0; y < h; y++) {
+        QRgb *p = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < w; x++) {
+            seed = seed * 1103515245 + 12345;
+            int n = (seed >> 16) & 63;
+            p[x] = qRgb(qMin(255, x * 192 / w + n), qMin(255, y * 192 / h + n), n * 4);
+        }
+    }
+    return img;
+}
+
+// best of RUNS, in milliseconds
+template <class F>
+static double
+timeIt(F f)
+{
+    double best = 0;
+    for (int i = 0; i < RUNS; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        f();
+        double ms = timer.nsecsElapsed() / 1e6;
+        if (!i || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+static bool
+check(const QImage &src, const QSize &size)
+{
+    QImage a = smoothScale(src, size), b = smoothScaleScalar(src, size, false);
+    if (a.size() != b.size()) {
+        printf("%dx%d -> %dx%d: result sizes differ\n",
+               src.width(), src.height(), size.width(), size.height());
+        return false;
+    }
+    int diffs = 0;
+    for (int y = 0; y < a.height(); y++) {
+        const QRgb *pa = reinterpret_cast<const QRgb *>(a.constScanLine(y));
+        const QRgb *pb = reinterpret_cast<const QRgb *>(b.constScanLine(y));
+        for (int x = 0; x < a.width(); x++)
+            if (pa[x] != pb[x])
+                diffs++;
+    }
+    if (diffs)
+        printf("%dx%d -> %dx%d: %d pixels differ\n",
+               src.width(), src.height(), size.width(), size.height(), diffs);
+    return !diffs;
+}
+
+static long
+maxRss()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss; // KiB
+}
+
+static void
+decodeFile(const char *file)
+{
+    static const struct {
+        int mode;
+        const char *name;
+    } modes[] = {
+        { KBackgroundSettings::Centred, "Centred" },
+        { KBackgroundSettings::Tiled, "Tiled" },
+        { KBackgroundSettings::CenterTiled, "CenterTiled" },
+        { KBackgroundSettings::CentredMaxpect, "CentredMaxpect" },
+        { KBackgroundSettings::TiledMaxpect, "TiledMaxpect" },
+        { KBackgroundSettings::Scaled, "Scaled" },
+        { KBackgroundSettings::CentredAutoFit, "CentredAutoFit" },
+        { KBackgroundSettings::ScaleAndCrop, "ScaleAndCrop" }
+    };
+    static const QSize size(1920, 1080);
+
+    printf("%s at %dx%d:\n%-15s %10s %12s %12s\n", file, size.width(), size.height(),
+           "mode", "time", "peak RSS", "growth");
+    for (unsigned i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        fflush(stdout);
+        // the peak RSS only ever grows, so every mode gets a fresh process
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return;
+        }
+        if (!pid) {
+            long base = maxRss();
+            QElapsedTimer timer;
+            timer.start();
+            QImage img = KBackgroundRenderer::readWallpaper(
+                QFile::decodeName(file), modes[i].mode, size, size, false);
+            double ms = timer.nsecsElapsed() / 1e6;
+            long peak = maxRss();
+            if (img.isNull())
+                printf("%-15s cannot be read\n", modes[i].name);
+            else
+                printf("%-15s %8.1fms %9ldKiB %9ldKiB\n", modes[i].name, ms, peak, peak - base);
+            fflush(stdout);
+            _exit(0);
+        }
+        waitpid(pid, 0, 0);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static const QSize sources[] = {
+        QSize(6000, 4000), QSize(1280, 800)
+    };
+    static const QSize targets[] = {
+        QSize(1920, 1080), QSize(3840, 2160), QSize(5120, 2880)
+    };
+    // odd sizes, so the single-tap tail and the edges get their share
+    static const QSize odd[][2] = {
+        { QSize(37, 23), QSize(5, 3) }, { QSize(5, 3), QSize(37, 23) },
+        { QSize(1001, 1), QSize(3, 1) }, { QSize(7, 7), QSize(1, 1) }
+    };
+    bool ok = true;
+
+    if (argc > 1) {
+        // before anything starts the scaler's threads, which fork() would lose
+        QCoreApplication app(argc, argv);
+        for (int i = 1; i < argc; i++)
+            decodeFile(argv[i]);
+        return 0;
+    }
+
+#ifdef __SSE2__
+    printf("filter: SSE2, checked against plain C\n\n");
+#else
+    printf("filter: plain C; there is nothing to check it against\n\n");
+#endif
+    printf("%-11s %-11s %10s %10s %10s %10s\n",
+           "source", "target", "parallel", "1 thread", "plain C", "QImage");
+    for (unsigned i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        QImage src = makeSource(sources[i]);
+        for (unsigned j = 0; j < sizeof(targets) / sizeof(targets[0]); j++) {
+            const QSize &size = targets[j];
+            double par = timeIt([&] { smoothScale(src, size); });
+            double one = timeIt([&] { smoothScale(src, size, false); });
+            double plain = timeIt([&] { smoothScaleScalar(src, size, false); });
+            double qt = timeIt([&] {
+                src.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            });
+            char from[16], to[16];
+            sprintf(from, "%dx%d", src.width(), src.height());
+            sprintf(to, "%dx%d", size.width(), size.height());
+            printf("%-11s %-11s %8.1fms %8.1fms %8.1fms %8.1fms\n",
+                   from, to, par, one, plain, qt);
+            ok &= check(src, size);
+        }
+    }
+    for (unsigned i = 0; i < sizeof(odd) / sizeof(odd[0]); i++)
+        ok &= check(makeSource(odd[i][0]), odd[i][1]);
+    printf("\n%s\n", ok ? "SSE2 and plain C agree" : "MISMATCH");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+/* vi: ts=8 sts=4 sw=4
+ * kate: space-indent on; tab-width 8; indent-width 4; indent-mode cstyle;
+ *
+ * This file is part of the KDE project, module kdm.
+ *
+ * You can Freely distribute this program under the GNU Library General
+ * Public License. See the file "COPYING.LIB" for the exact licensing terms.
+ */
+
+// smoothScale() with the plain C filter, for bgscalebench to check against
+
+#define BGSCALE_NO_SIMD
+#define smoothScale smoothScaleScalar
+
+#include "bgscale.cpp"
@@ -16,7 +16,9 @@
 #undef Bool
 #undef Unsorted
 
+#include <QDateTime>
 #include <QDir>
+#include <QHash>
 #include <QPixmap>
 
 #include <kdesktopfile.h>
@@ -436,6 +438,8 @@ KBackgroundSettings::KBackgroundSettings(int screen, bool drawBackgroundPerScree
 {
     dirty = false;
     hashdirty = true;
+    statedirty = false;
+    m_ShuffleSeed = 0;
     m_bDrawBackgroundPerScreen = drawBackgroundPerScreen;
     m_Screen = screen;
     m_bEnabled = true;
@@ -525,6 +529,8 @@ void KBackgroundSettings::copyConfig(const KBackgroundSettings *settings)
     m_Wallpaper = settings->m_Wallpaper;
     m_WallpaperList = settings->m_WallpaperList;
     m_WallpaperFiles = settings->m_WallpaperFiles;
+    m_WallpaperOrder = settings->m_WallpaperOrder;
+    m_ShuffleSeed = settings->m_ShuffleSeed;
 
     m_BackgroundMode = settings->m_BackgroundMode;
     m_WallpaperMode = settings->m_WallpaperMode;
@@ -659,7 +665,7 @@ void KBackgroundSettings::setWallpaperList(const QStringList &list)
     }
     updateWallpaperFiles();
     // Try to keep the current wallpaper (-1 to set position to one before it)
-    m_CurrentWallpaper = m_WallpaperFiles.indexOf(m_CurrentWallpaperName) - 1;
+    m_CurrentWallpaper = wallpaperPosition(m_CurrentWallpaperName) - 1;
     changeWallpaper(m_CurrentWallpaper < 0);
 }
 
@@ -776,6 +782,7 @@ void KBackgroundSettings::readSettings(bool reparse)
     m_LastChange = cg.readEntry("LastChange", 0);
     m_CurrentWallpaper = cg.readEntry("CurrentWallpaper", 0);
     m_CurrentWallpaperName = cg.readEntry("CurrentWallpaperName");
+    m_ShuffleSeed = cg.readEntry("ShuffleSeed", 0);
 
     m_MultiMode = defMultiMode;
     s = cg.readEntry("MultiWallpaperMode");
@@ -786,7 +793,7 @@ void KBackgroundSettings::readSettings(bool reparse)
 
     updateWallpaperFiles();
     if (!m_CurrentWallpaperName.isEmpty())
-        m_CurrentWallpaper = m_WallpaperFiles.indexOf(m_CurrentWallpaperName);
+        m_CurrentWallpaper = wallpaperPosition(m_CurrentWallpaperName);
     if (m_CurrentWallpaper < 0)
         m_CurrentWallpaper = 0;
 
@@ -843,6 +850,16 @@ void KBackgroundSettings::writeSettings()
     dirty = false;
 }
 
+/*
+ * Listings of the wallpaper directories, shared by all screens. A
+ * directory is read again only when its modification time changed.
+ */
+struct WallpaperDir {
+    QDateTime mtime;
+    QStringList files;
+};
+static QHash<QString, WallpaperDir> wallpaperDirs;
+
 /*
  * (re)Build m_WallpaperFiles from m_WallpaperList
  */
@@ -864,42 +881,73 @@ void KBackgroundSettings::updateWallpaperFiles()
         if (fi.isFile() && fi.isReadable()) {
             m_WallpaperFiles.append(file);
         } else if (fi.isDir()) {
-            QDir dir(file);
-            QStringList lst = dir.entryList(QDir::Files | QDir::Readable);
-            QStringList::Iterator it;
-            for (it = lst.begin(); it != lst.end(); ++it) {
-                file = dir.absoluteFilePath(*it);
-                QFileInfo fi(file);
-                if (fi.isFile() && fi.isReadable())
-                    m_WallpaperFiles.append(file);
+            WallpaperDir &wd = wallpaperDirs[file];
+            QDateTime mtime = fi.lastModified();
+            if (!wd.mtime.isValid() || wd.mtime != mtime) {
+                wd.mtime = mtime;
+                wd.files.clear();
+                QDir dir(file);
+                QStringList lst = dir.entryList(QDir::Files | QDir::Readable);
+                QStringList::Iterator it;
+                for (it = lst.begin(); it != lst.end(); ++it) {
+                    file = dir.absoluteFilePath(*it);
+                    QFileInfo fi(file);
+                    if (fi.isFile() && fi.isReadable())
+                        wd.files.append(file);
+                }
             }
+            m_WallpaperFiles += wd.files;
         } else {
             qWarning() << Q_FUNC_INFO << "Wallpaper" << file << "is not a readable file or directory";
         }
     }
 
     if (m_MultiMode == Random) {
-        randomizeWallpaperFiles();
+        // restore the order from before a restart, if there is one
+        if (m_ShuffleSeed)
+            shuffleWallpaperFiles();
+        else
+            randomizeWallpaperFiles();
+    } else {
+        m_WallpaperOrder.resize(m_WallpaperFiles.count());
+        for (int i = 0; i < m_WallpaperOrder.count(); i++)
+            m_WallpaperOrder[i] = i;
     }
 }
 
-// Randomize the m_WallpaperFiles in a non-repeating method.
+// Randomize the wallpaper order in a non-repeating method.
 void KBackgroundSettings::randomizeWallpaperFiles()
 {
-    if (m_WallpaperFiles.count() < 4)
+    KRandomSequence rseq;
+    do
+        m_ShuffleSeed = rseq.getLong(0x7fffffff);
+    while (!m_ShuffleSeed);
+    shuffleWallpaperFiles();
+}
+
+/*
+ * Fisher-Yates shuffle of all files, seeded with m_ShuffleSeed. Only the
+ * seed needs to be remembered to get the same order again.
+ */
+void KBackgroundSettings::shuffleWallpaperFiles()
+{
+    int n = m_WallpaperFiles.count();
+    m_WallpaperOrder.resize(n);
+    for (int i = 0; i < n; i++)
+        m_WallpaperOrder[i] = i;
+    if (n < 4)
         return;
 
-    KRandomSequence rseq;
-    QStringList tmpList = m_WallpaperFiles;
-    QStringList randomList;
-    randomList.append(tmpList.front());
-    tmpList.pop_front();
-    while (tmpList.count()) {
-        long t = rseq.getLong(randomList.count() + 1);
-        randomList.insert(t, tmpList.front());
-        tmpList.pop_front();
-    }
-    m_WallpaperFiles = randomList;
+    KRandomSequence rseq(m_ShuffleSeed);
+    for (int i = n - 1; i > 0; i--)
+        qSwap(m_WallpaperOrder[i], m_WallpaperOrder[rseq.getLong(i + 1)]);
+}
+
+// @return the position of file in the wallpaper order, or -1
+int KBackgroundSettings::wallpaperPosition(const QString &file) const
+{
+    int i = m_WallpaperFiles.indexOf(file);
+    return i < 0 ? -1 : m_WallpaperOrder.indexOf(i);
 }
 
 QStringList KBackgroundSettings::wallpaperList() const
@@ -917,7 +965,11 @@ QStringList KBackgroundSettings::wallpaperFiles() const
         return QStringList();
     if (m_MultiMode == NoMulti || m_MultiMode == NoMultiRandom)
         return QStringList(m_Wallpaper);
-    return m_WallpaperFiles;
+    QStringList ret;
+    ret.reserve(m_WallpaperOrder.count());
+    foreach (int i, m_WallpaperOrder)
+        ret.append(m_WallpaperFiles[i]);
+    return ret;
 }
 
 /*
@@ -925,7 +977,7 @@ QStringList KBackgroundSettings::wallpaperFiles() const
  */
 void KBackgroundSettings::changeWallpaper(bool init)
 {
-    if (m_WallpaperFiles.count() == 0) {
+    if (m_WallpaperOrder.isEmpty()) {
         if (init) {
             m_CurrentWallpaper = 0;
             m_CurrentWallpaperName = QString();
@@ -936,15 +988,15 @@ void KBackgroundSettings::changeWallpaper(bool init)
     switch (m_MultiMode) {
     case InOrder:
         m_CurrentWallpaper++;
-        if (init || (m_CurrentWallpaper >= (int) m_WallpaperFiles.count()))
+        if (init || (m_CurrentWallpaper >= m_WallpaperOrder.count()))
             m_CurrentWallpaper = 0;
         break;
 
     case Random:
-        // Random: m_WallpaperFiles is randomized in a non-repeating
+        // Random: m_WallpaperOrder is randomized in a non-repeating
         //  method.  Hence we just increment the index.
         m_CurrentWallpaper++;
-        if (init || (m_CurrentWallpaper >= (int) m_WallpaperFiles.count())) {
+        if (init || (m_CurrentWallpaper >= m_WallpaperOrder.count())) {
             m_CurrentWallpaper = 0;
             randomizeWallpaperFiles(); // Get a new random-ordered list.
         }
@@ -953,26 +1005,53 @@ void KBackgroundSettings::changeWallpaper(bool init)
         break;
     }
 
-    m_CurrentWallpaperName = m_WallpaperFiles[ m_CurrentWallpaper ];
+    m_CurrentWallpaperName = m_WallpaperFiles[m_WallpaperOrder[m_CurrentWallpaper]];
     m_LastChange = (int) time(0L);
     KConfigGroup conf(m_pConfig, configGroupName());
     conf.deleteEntry("CurrentWallpaper"); // obsolete, remember name
     conf.writeEntry("CurrentWallpaperName", m_CurrentWallpaperName);
     conf.writeEntry("LastChange", m_LastChange);
-    m_pConfig->sync();
+    if (m_MultiMode == Random)
+        conf.writeEntry("ShuffleSeed", m_ShuffleSeed);
+    // written out by syncWallpaperState(), off the path of the switch
+    statedirty = true;
 
     hashdirty = true;
 }
 
 
+void KBackgroundSettings::syncWallpaperState()
+{
+    if (!statedirty)
+        return;
+    statedirty = false;
+    m_pConfig->sync();
+}
+
+
+QString KBackgroundSettings::nextWallpaper() const
+{
+    if (m_MultiMode != InOrder && m_MultiMode != Random)
+        return QString();
+    int next = m_CurrentWallpaper + 1;
+    if (next >= m_WallpaperOrder.count()) {
+        // Random reshuffles at the end of the list
+        if (m_MultiMode == Random || m_WallpaperOrder.isEmpty())
+            return QString();
+        next = 0;
+    }
+    return m_WallpaperFiles[m_WallpaperOrder[next]];
+}
+
+
 QString KBackgroundSettings::currentWallpaper() const
 {
     if (m_WallpaperMode == NoWallpaper)
         return QString();
     if (m_MultiMode == NoMulti || m_MultiMode == NoMultiRandom)
         return m_Wallpaper;
-    if (m_CurrentWallpaper >= 0 && m_CurrentWallpaper < (int) m_WallpaperFiles.count())
-        return m_WallpaperFiles[m_CurrentWallpaper];
+    if (m_CurrentWallpaper >= 0 && m_CurrentWallpaper < m_WallpaperOrder.count())
+        return m_WallpaperFiles[m_WallpaperOrder[m_CurrentWallpaper]];
     return QString();
 }
 
@@ -981,7 +1060,15 @@ bool KBackgroundSettings::discardCurrentWallpaper()
     if (m_MultiMode == NoMulti || m_MultiMode == NoMultiRandom) {
         return false;
     }
-    m_WallpaperFiles.removeAll(m_WallpaperFiles.at(m_CurrentWallpaper));
+    if (m_CurrentWallpaper < 0 || m_CurrentWallpaper >= m_WallpaperOrder.count())
+        return false;
+    // drop the file for good, so a reshuffle does not bring it back
+    int file = m_WallpaperOrder[m_CurrentWallpaper];
+    m_WallpaperFiles.removeAt(file);
+    m_WallpaperOrder.remove(m_CurrentWallpaper);
+    for (int i = 0; i < m_WallpaperOrder.count(); i++)
+        if (m_WallpaperOrder[i] > file)
+            m_WallpaperOrder[i]--;
     --m_CurrentWallpaper;
     changeWallpaper();
 
@@ -14,6 +14,7 @@
 
 #include <QColor>
 #include <QMap>
+#include <QVector>
 #include <ksharedconfig.h>
 
 template <class QString, class T> class QMap;
@@ -239,6 +240,18 @@ public:
     bool discardCurrentWallpaper();
     int lastWallpaperChange() const { return m_LastChange; }
     bool needWallpaperChange();
+    /**
+     * @return the wallpaper the next changeWallpaper() is going to pick,
+     *  or an empty string if that cannot be predicted
+     */
+    QString nextWallpaper() const;
+    /**
+     * changeWallpaper() only records the new state in the configuration
+     * object; this writes it to disk. The renderer does that only when it
+     * is destroyed, so long-lived users should call this after each
+     * round of changes, once for all screens.
+     */
+    void syncWallpaperState();
 
     void readSettings(bool reparse = false);
     void writeSettings();
@@ -252,9 +265,12 @@ public:
 
 private:
     void updateHash();
+    void shuffleWallpaperFiles();
+    int wallpaperPosition(const QString &file) const;
 
     bool dirty;
     bool hashdirty;
+    bool statedirty;
     int m_Screen, m_Hash;
 
     QColor m_ColorA, defColorA;
@@ -275,6 +291,10 @@ private:
     int m_Interval, m_LastChange;
     int m_CurrentWallpaper;
     QString m_CurrentWallpaperName;
+    // play order as indices into m_WallpaperFiles; m_CurrentWallpaper
+    // is a position in this
+    QVector<int> m_WallpaperOrder;
+    int m_ShuffleSeed;
 
     KSharedConfigPtr m_pConfig;
     KStandardDirs *m_pDirs;
@@ -143,16 +143,17 @@ typedef struct {
 } OCABuf;
 
 static void
-outCh_OCA(void *bp, char c)
+out_OCA(void *bp, const char *s, int len)
 {
     OCABuf *ocabp = (OCABuf *)bp;
 
-    ocabp->tlen++;
-    if (ocabp->clen >= ocabp->blen) {
-        ocabp->blen = ocabp->blen * 3 / 2 + 100;
+    ocabp->tlen += len;
+    if (ocabp->clen + len > ocabp->blen) {
+        ocabp->blen = (ocabp->clen + len) * 3 / 2 + 100;
         ocabp->buf = mrealloc(ocabp->buf, ocabp->blen);
     }
-    ocabp->buf[ocabp->clen++] = c;
+    memcpy(ocabp->buf + ocabp->clen, s, len);
+    ocabp->clen += len;
 }
 
 static int
@@ -160,8 +161,8 @@ VASPrintf(char **strp, const char *fmt, va_list args)
 {
     OCABuf ocab = { 0, 0, 0, -1 };
 
-    doPrint(outCh_OCA, &ocab, fmt, args);
-    outCh_OCA(&ocab, 0);
+    doPrint(out_OCA, &ocab, fmt, args);
+    out_OCA(&ocab, "", 1);
     *strp = realloc(ocab.buf, ocab.clen);
     if (!*strp)
         *strp = ocab.buf;
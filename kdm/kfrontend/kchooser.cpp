@@ -203,41 +203,44 @@ QString ChooserDlg::recvStr()
         return i18nc("hostname or status", "<unknown>"); //krazy:exclude=i18ncheckarg
 }
 
-ChooserListViewItem *ChooserDlg::findItem(int id)
+void ChooserDlg::readHost(int cmd)
 {
-    for (int i = 0, rc = host_view->model()->rowCount(); i < rc; i++) {
-        ChooserListViewItem *itm = static_cast<ChooserListViewItem *>(
-            host_view->topLevelItem(i));
-        if (itm->id == id)
-            return itm;
+    int id = gRecvInt();
+    if (cmd == G_Ch_RemoveHost) {
+        delete items.take(id);
+        return;
+    }
+    QString nam = recvStr();
+    QString sts = recvStr();
+    gRecvInt(); /* swallow willing for now */
+    if (cmd == G_Ch_AddHost) {
+        items.insert(id, new ChooserListViewItem(host_view, id, nam, sts));
+    } else if (ChooserListViewItem *itm = items.value(id)) {
+        itm->setText(0, nam);
+        itm->setText(1, sts);
     }
-    return 0;
 }
 
 void ChooserDlg::slotReadPipe()
 {
-    int id;
-    QString nam, sts;
-
     int cmd = gRecvInt();
     switch (cmd) {
     case G_Ch_AddHost:
     case G_Ch_ChangeHost:
-        id = gRecvInt();
-        nam = recvStr();
-        sts = recvStr();
-        gRecvInt(); /* swallow willing for now */
-        if (cmd == G_Ch_AddHost) {
-            new ChooserListViewItem(host_view, id, nam, sts);
-        } else {
-            QTreeWidgetItem *itm = findItem(id);
-            itm->setText(0, nam);
-            itm->setText(1, sts);
-        }
-        break;
     case G_Ch_RemoveHost:
-        delete findItem(gRecvInt());
+        readHost(cmd);
         break;
+    case G_Ch_HostBatch: {
+        // hundreds of hosts may arrive at once; update the view only once
+        int cnt = gRecvInt();
+        bool sorted = host_view->isSortingEnabled();
+        host_view->setUpdatesEnabled(false);
+        host_view->setSortingEnabled(false);
+        while (cnt--)
+            readHost(gRecvInt());
+        host_view->setSortingEnabled(sorted);
+        host_view->setUpdatesEnabled(true);
+        break; }
     case G_Ch_BadHost:
         KFMsgBox::box(this, QMessageBox::Warning, i18n("Unknown host %1", recvStr()));
         break;
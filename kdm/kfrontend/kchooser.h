@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "kgdialog.h"
 
+#include <QHash>
 #include <QTimer>
 
 class ChooserListViewItem;
@@ -55,8 +56,9 @@ class ChooserDlg : public KGDialog {
 
   private:
     QString recvStr();
-    ChooserListViewItem *findItem(int id);
+    void readHost(int cmd);
 
+    QHash<int, ChooserListViewItem *> items;
     QTimer timer;
     QTreeWidget *host_view;
     QLineEdit *iline;
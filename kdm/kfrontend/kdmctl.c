@@ -84,10 +84,13 @@ readConfig(const char *cfg)
     return ctl;
 }
 
+static int lines;
+
 static int
 exe(int fd, const char *in, int len)
 {
     char buf[4096];
+    int i;
 
     if (write(fd, in, len) != len) {
         fprintf(stderr, "Cannot send command\n");
@@ -98,6 +101,10 @@ exe(int fd, const char *in, int len)
             fprintf(stderr, "Cannot receive reply\n");
             return 1;
         }
+        if (lines)
+            for (i = 0; i < len; i++)
+                if (buf[i] == '\t')
+                    buf[i] = '\n';
         fwrite(buf, 1, len, stdout);
     } while (buf[len - 1] != '\n');
     return 0;
@@ -170,6 +177,7 @@ main(int argc, char **argv)
 " -d -display  Override $DISPLAY\n"
 " -s -sockets  Override $DM_CONTROL\n"
 " -c -config   Use alternative kdm config file\n"
+" -l -lines    Print each token of the reply on a separate line\n"
 "\n"
 "The directory in which the sockets are located is determined this way:\n"
 "- the -s option is examined\n"
@@ -190,6 +198,8 @@ main(int argc, char **argv)
             return 0;
         } else if (!strcmp(ptr, "g") || !strcmp(ptr, "global")) {
             dpy = 0;
+        } else if (!strcmp(ptr, "l") || !strcmp(ptr, "lines")) {
+            lines = 1;
         } else if (!strcmp(ptr, "d") || !strcmp(ptr, "display")) {
             if (!argv[1])
                 goto needarg;
@@ -27,6 +27,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "kdmconfig.h"
 #include "kdmclock.h"
 #include "kdm_greet.h"
+#include "kgreeterusers.h"
 #ifdef KDM_THEMEABLE
 #include "themer/kdmthemer.h"
 #include "themer/kdmitem.h"
@@ -42,6 +43,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QStandardPaths>
 #include <QAction>
 #include <QBuffer>
+#include <QDataStream>
 #include <QDir>
 #include <QFile>
 #include <QImageReader>
@@ -49,10 +51,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QLabel>
 #include <QListWidget>
 #include <QListWidgetItem>
+#include <QLocale>
 #include <QMenu>
 #include <QMovie>
 #include <QPainter>
 #include <QPushButton>
+#include <QSaveFile>
 #include <QShortcut>
 #include <QStyle>
 
@@ -176,7 +180,8 @@ KGreeter::KGreeter(bool framed)
     : inherited(framed)
     , dName(dname)
     , userView(0)
-    , userList(0)
+    , userNames(0)
+    , userEnum(0)
     , nNormals(0)
     , nSpecials(0)
     , curPrev(0)
@@ -194,8 +199,8 @@ KGreeter::KGreeter(bool framed)
                 SLOT(accept()));
     }
     if (_userCompletion)
-        userList = new QStringList;
-    if (userView || userList)
+        userNames = new KGreeterUserNames;
+    if (userView || userNames)
         insertUsers();
 
     sessMenu = new QMenu(this);
@@ -214,8 +219,9 @@ KGreeter::KGreeter(bool framed)
 KGreeter::~KGreeter()
 {
     hide();
-    delete userList;
+    delete userEnum;
     delete verify;
+    delete userNames;
     delete stsGroup;
 }
 
@@ -299,11 +305,6 @@ void
 KGreeter::insertUser(const QImage &default_pix,
                      const QString &username, struct passwd *ps)
 {
-    if (userList)
-        userList->append(username);
-    if (!userView)
-        return;
-
     int dp = 0, nd = 0;
     if (_faceSource == FACE_USER_ONLY ||
         _faceSource == FACE_PREFER_USER)
@@ -367,86 +368,180 @@ UserList::UserList(char **in)
         }
 }
 
-void
-KGreeter::insertUsers()
+class UserSink {
+  public:
+    virtual ~UserSink() {}
+    // return false to suspend the enumeration
+    virtual bool addUser(const char *name, struct passwd *ps) = 0;
+};
+
+// the user database is read with the privileges of nobody
+static bool
+dropPrivileges()
 {
     struct passwd *ps;
 
+    if (getuid())
+        return true;
+    if (!(ps = getpwnam("nobody")))
+        return false;
+    if (setegid(ps->pw_gid))
+        return false;
+    if (seteuid(ps->pw_uid)) {
+        setegid(0);
+        return false;
+    }
+    return true;
+}
+
+static void
+restorePrivileges()
+{
     if (!getuid()) {
-        if (!(ps = getpwnam("nobody")))
-            return;
-        if (setegid(ps->pw_gid))
-            return;
-        if (seteuid(ps->pw_uid)) {
-            setegid(0);
-            return;
-        }
+        seteuid(0);
+        setegid(0);
     }
+}
 
-    QImage default_pix;
-    if (userView) {
-        QByteArray fn = QFile::encodeName(_faceDir) + "/.default.face.icon";
-        if (!loadFace(fn, default_pix, QByteArray(), true)) {
-            default_pix = QImage(48, 48, QImage::Format_ARGB32);
-            default_pix.fill(0);
+static UserList *
+newUserFilter()
+{
+    return new UserList(_showUsers == SHOW_ALL ? _noUsers : _users);
+}
+
+/*
+ * Feed the users to be shown to sink. list is the filter from
+ * newUserFilter(); pos must be 0 initially. If the sink returns false,
+ * the enumeration is suspended and false is returned; calling this
+ * again with the same pos resumes it.
+ */
+static bool
+enumerateUsers(UserSink *sink, const UserList &list, int *pos)
+{
+    struct passwd *ps;
+
+    if (_showUsers != SHOW_ALL && !list.hasGroups()) {
+        while (_users[*pos]) {
+            const char *name = _users[(*pos)++];
+            if ((ps = getpwnam(name)) && (ps->pw_uid || _showRoot) &&
+                !sink->addUser(name, ps))
+                return false;
         }
-    }
-    if (_showUsers == SHOW_ALL) {
-        UserList noUsers(_noUsers);
-        QSet<QString> dupes;
-        for (setpwent(); (ps = getpwent()) != 0;) {
+    } else {
+        if (!(*pos)++)
+            setpwent();
+        while ((ps = getpwent()) != 0) {
             if (*ps->pw_dir && *ps->pw_shell &&
                 (ps->pw_uid >= (unsigned)_lowUserId ||
                  (!ps->pw_uid && _showRoot)) &&
                 ps->pw_uid <= (unsigned)_highUserId &&
-                !noUsers.hasUser(ps->pw_name) &&
-                !noUsers.hasGroup(ps->pw_gid))
-            {
-                QString username(QFile::decodeName(ps->pw_name));
-                if (!dupes.contains(username)) {
-                    dupes.insert(username);
-                    insertUser(default_pix, username, ps);
-                }
-            }
-        }
-    } else {
-        UserList users(_users);
-        if (users.hasGroups()) {
-            QSet<QString> dupes;
-            for (setpwent(); (ps = getpwent()) != 0;) {
-                if (*ps->pw_dir && *ps->pw_shell &&
-                    (ps->pw_uid >= (unsigned)_lowUserId ||
-                     (!ps->pw_uid && _showRoot)) &&
-                    ps->pw_uid <= (unsigned)_highUserId &&
-                    (users.hasUser(ps->pw_name) ||
-                     users.hasGroup(ps->pw_gid)))
-                {
-                    QString username(QFile::decodeName(ps->pw_name));
-                    if (!dupes.contains(username)) {
-                        dupes.insert(username);
-                        insertUser(default_pix, username, ps);
-                    }
-                }
-            }
-        } else {
-            for (int i = 0; _users[i]; i++)
-                if ((ps = getpwnam(_users[i])) && (ps->pw_uid || _showRoot))
-                    insertUser(default_pix, QFile::decodeName(_users[i]), ps);
+                (_showUsers == SHOW_ALL ?
+                    !list.hasUser(ps->pw_name) && !list.hasGroup(ps->pw_gid) :
+                    list.hasUser(ps->pw_name) || list.hasGroup(ps->pw_gid)) &&
+                !sink->addUser(ps->pw_name, ps))
+                return false;
         }
     }
     endpwent();
     endgrent();
-    if (_sortUsers) {
-        if (userView)
-            userView->sortItems();
-        if (userList)
-            userList->sort();
+    return true;
+}
+
+#define USER_BATCH 256
+
+UserEnumerator::UserEnumerator(KGreeterUserNames *_names, QObject *parent)
+    : QObject(parent)
+    , names(_names)
+    , list(0)
+    , pos(0)
+    , done(false)
+{
+    QTimer::singleShot(0, this, SLOT(slotBatch()));
+}
+
+UserEnumerator::~UserEnumerator()
+{
+    // close the user database if the enumeration was cut short
+    if (!done && list && (_showUsers == SHOW_ALL || list->hasGroups())) {
+        endpwent();
+        endgrent();
     }
+    delete list;
+}
 
-    if (!getuid()) {
-        seteuid(0);
-        setegid(0);
+void
+UserEnumerator::slotBatch()
+{
+    class BatchSink : public UserSink {
+      public:
+        virtual bool addUser(const char *name, struct passwd *)
+        {
+            batch.append(QByteArray(name));
+            return batch.count() < USER_BATCH;
+        }
+        QList<QByteArray> batch;
+    } sink;
+
+    if (!dropPrivileges()) {
+        done = true;
+        return;
+    }
+    if (!list)
+        list = newUserFilter();
+    done = enumerateUsers(&sink, *list, &pos);
+    restorePrivileges();
+    names->insert(sink.batch);
+    if (!done)
+        QTimer::singleShot(0, this, SLOT(slotBatch()));
+}
+
+void
+KGreeter::insertUsers()
+{
+    if (!userView) {
+        // only needed for completion, which can do with a partial list
+        userEnum = new UserEnumerator(userNames, this);
+        return;
     }
+
+    if (!dropPrivileges())
+        return;
+
+    class ViewSink : public UserSink {
+      public:
+        ViewSink(KGreeter *_g) : g(_g) {}
+        virtual bool addUser(const char *name, struct passwd *ps)
+        {
+            QString username(QFile::decodeName(name));
+            if (!dupes.contains(username)) {
+                dupes.insert(username);
+                g->insertUser(defaultPix, username, ps);
+                if (g->userNames)
+                    names.append(QByteArray(name));
+            }
+            return true;
+        }
+        KGreeter *g;
+        QImage defaultPix;
+        QSet<QString> dupes;
+        QList<QByteArray> names;
+    } sink(this);
+
+    QByteArray fn = QFile::encodeName(_faceDir) + "/.default.face.icon";
+    if (!loadFace(fn, sink.defaultPix, QByteArray(), true)) {
+        sink.defaultPix = QImage(48, 48, QImage::Format_ARGB32);
+        sink.defaultPix.fill(0);
+    }
+    UserList *list = newUserFilter();
+    int pos = 0;
+    enumerateUsers(&sink, *list, &pos);
+    delete list;
+    if (userNames)
+        userNames->insert(sink.names);
+    if (_sortUsers)
+        userView->sortItems();
+
+    restorePrivileges();
 }
 
 void
@@ -463,9 +558,77 @@ KGreeter::putSession(const QString &type, const QString &name, bool hid, const c
     sessionTypes.append(SessType(name, type, hid, prio));
 }
 
+/*
+ * Reading all session .desktop files and resolving their TryExecs is
+ * expensive, so the resulting catalog is cached in the data dir. The
+ * cache is keyed by the mtimes of the session dirs and the PATH dirs
+ * (a TryExec may become available), by the mtimes and sizes of the
+ * session files (which may be edited in place) and by the language.
+ */
+#define SESSION_CACHE_VERSION 1
+
+struct SessEnt {
+    QString type, name;
+    bool hid;
+    QByteArray exe;
+};
+
+static QByteArray
+sessionCacheKey()
+{
+    QByteArray key;
+    QDataStream ds(&key, QIODevice::WriteOnly);
+    QList<QByteArray> dirs;
+    struct stat st;
+
+    ds << QLocale().name();
+    for (char **dit = _sessionsDirs; *dit; ++dit) {
+        dirs << *dit;
+        foreach (const QString &ent,
+                 QDir(*dit).entryList(QStringList("*.desktop"), QDir::NoFilter,
+                                      QDir::Name))
+        {
+            QByteArray fn = QFile::encodeName(QString(*dit).append('/').append(ent));
+            if (!stat(fn.constData(), &st))
+                ds << fn << (qint64)st.st_mtime << (qint64)st.st_size;
+        }
+    }
+    dirs += qgetenv("PATH").split(':');
+    foreach (const QByteArray &dir, dirs)
+        if (!dir.isEmpty())
+            ds << dir << (qint64)(stat(dir.constData(), &st) ? -1 : st.st_mtime);
+    return key;
+}
+
 void
 KGreeter::insertSessions()
 {
+    QList<SessEnt> ents;
+    QByteArray key = sessionCacheKey();
+    QString cacheName = _dataDir + "/sessions.cache";
+
+    QFile cache(cacheName);
+    if (cache.open(QIODevice::ReadOnly)) {
+        QByteArray data = cache.readAll();
+        QDataStream ds(data);
+        qint32 version, count;
+        QByteArray ckey;
+        ds >> version;
+        if (version == SESSION_CACHE_VERSION) {
+            ds >> ckey >> count;
+            if (ckey == key) {
+                for (SessEnt se; count > 0 && ds.status() == QDataStream::Ok; count--) {
+                    ds >> se.type >> se.name >> se.hid >> se.exe;
+                    ents << se;
+                }
+                if (ds.status() != QDataStream::Ok)
+                    ents.clear();
+                else
+                    goto cached;
+            }
+        }
+    }
+
     for (char **dit = _sessionsDirs; *dit; ++dit)
         foreach (QString ent, QDir(*dit).entryList())
             if (ent.endsWith(".desktop")) {
@@ -473,14 +636,30 @@ KGreeter::insertSessions()
                     KSharedConfig::openConfig(
                         QString(*dit).append('/').append(ent)),
                     "Desktop Entry");
-                putSession(ent.left(ent.length() - 8),
-                            dsk.readEntry("Name"),
-                            (dsk.readEntry("Hidden", false) ||
-                             (dsk.hasKey("TryExec") &&
-                              QStandardPaths::findExecutable(
-                                  dsk.readEntry("TryExec")).isEmpty())),
-                            dsk.readEntry("Exec").toLatin1());
+                SessEnt se;
+                se.type = ent.left(ent.length() - 8);
+                se.name = dsk.readEntry("Name");
+                se.hid = dsk.readEntry("Hidden", false) ||
+                         (dsk.hasKey("TryExec") &&
+                          QStandardPaths::findExecutable(
+                              dsk.readEntry("TryExec")).isEmpty());
+                se.exe = dsk.readEntry("Exec").toLatin1();
+                ents << se;
             }
+    {
+        QSaveFile sf(cacheName);
+        if (sf.open(QIODevice::WriteOnly)) {
+            QDataStream ds(&sf);
+            ds << (qint32)SESSION_CACHE_VERSION << key << (qint32)ents.count();
+            foreach (const SessEnt &se, ents)
+                ds << se.type << se.name << se.hid << se.exe;
+            sf.commit();
+        }
+    }
+
+  cached:
+    foreach (const SessEnt &se, ents)
+        putSession(se.type, se.name, se.hid, se.exe.constData());
     putSession("default", i18nc("@item:inlistbox session type", "Default"), false, "default");
     putSession("custom", i18nc("@item:inlistbox session type", "Custom"), false, "custom");
     putSession("failsafe", i18nc("@item:inlistbox session type", "Failsafe"), false, "failsafe");
@@ -590,7 +769,7 @@ KGreeter::slotLoadPrevWM()
         gSendStr("Session");
         sess = gRecvStr();
         if (!sess) { /* no such user */
-            if (!userView && !userList) { // don't fake if user list shown
+            if (!userView && !userNames) { // don't fake if user list shown
                 prevValid = false;
                 /* simple crc32 */
                 for (crc = _forgingSeed, i = 0; i < len; i++) {
@@ -651,8 +830,33 @@ KGreeter::pluginSetup()
             _focusPasswd;
     }
     verify->presetEntity(ent, field);
-    if (userList)
-        verify->loadUsers(*userList);
+    if (userNames)
+        verify->loadUsers(userNames);
+    prefetchDmrcs(verify->entitiesLocal() ? ent : QString());
+}
+
+// let the core read the .dmrc files of the likely users in the background
+void // protected
+KGreeter::prefetchDmrcs(const QString &first)
+{
+    QStringList users;
+
+    if (verify->coreState != KGVerify::CoreIdle)
+        return;
+    if (!first.isEmpty())
+        users << first;
+    if (userView)
+        for (int i = 0, rc = userView->count(); i < rc && users.count() < 16; i++) {
+            QString login = static_cast<UserListViewItem *>(userView->item(i))->login;
+            if (!users.contains(login))
+                users << login;
+        }
+    if (users.isEmpty())
+        return;
+    gSendInt(G_PrefetchDmrc);
+    gSendInt(users.count());
+    foreach (const QString &user, users)
+        gSendStr(user.toLocal8Bit().data());
 }
 
 void
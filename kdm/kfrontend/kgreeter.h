@@ -29,14 +29,39 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "kgverify.h"
 #include "kgdialog.h"
 
+class UserList;
 class UserListView;
 class KdmClock;
 class KdmItem;
 
 class KConfigGroup;
+class KGreeterUserNames;
 class QListWidgetItem;
 class QActionGroup;
 
+/*
+ * Enumerates the users for completion in batches from the event loop,
+ * so a large directory does not hold up the greeter. This cannot be
+ * done in a thread, as passwd and group are read with the effective
+ * uid of nobody and the lookups are not thread-safe.
+ */
+class UserEnumerator : public QObject {
+    Q_OBJECT
+
+  public:
+    UserEnumerator(KGreeterUserNames *names, QObject *parent);
+    ~UserEnumerator();
+
+  private Q_SLOTS:
+    void slotBatch();
+
+  private:
+    KGreeterUserNames *names;
+    UserList *list;
+    int pos;
+    bool done;
+};
+
 struct SessType {
     QString name, type;
     QAction *action;
@@ -75,11 +100,13 @@ class KGreeter : public KGDialog, public KGVerifyHandler {
     void insertSessions();
     virtual void pluginSetup();
     void setPrevWM(QAction *);
+    void prefetchDmrcs(const QString &first);
 
     QString curUser, dName;
     KConfigGroup *stsGroup;
     UserListView *userView;
-    QStringList *userList;
+    KGreeterUserNames *userNames;
+    UserEnumerator *userEnum;
     QMenu *sessMenu;
     QActionGroup *sessGroup;
     QVector<SessType> sessionTypes;
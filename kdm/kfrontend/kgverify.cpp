@@ -220,10 +220,14 @@ KGVerify::slotPluginSelected(QAction *action)
 }
 
 void // public
-KGVerify::loadUsers(const QStringList &users)
+KGVerify::loadUsers(const KGreeterUserNames *users)
 {
     debug("%s->loadUsers(...)\n", pName.data());
-    greet->loadUsers(users);
+    // older talkers know only the list; they get what is there so far
+    if (greetPlugins[pluginList[curPlugin]].info->flags & KGreeterPluginInfo::UserStore)
+        greet->loadUserStore(users);
+    else
+        greet->loadUsers(users->toStringList());
 }
 
 void // public
@@ -936,6 +940,8 @@ KGVerify::getConf(void *, const char *key, const QVariant &dflt)
 {
     if (!qstrcmp(key, "EchoPasswd")) {
         return QVariant(_echoPasswd);
+    } else if (!qstrcmp(key, "DataDir")) {
+        return QVariant(_dataDir);
     } else {
         QString fkey = QString::fromLatin1(key) + '=';
         foreach (const QString& pgo, _pluginOptions)
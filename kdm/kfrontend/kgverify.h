@@ -100,7 +100,7 @@ class KGVerify : public QObject, public KGreeterPluginHandler {
              KGreeterPlugin::Function func, KGreeterPlugin::Context ctx);
     virtual ~KGVerify();
     QMenu *getPlugMenu();
-    void loadUsers(const QStringList &users);
+    void loadUsers(const KGreeterUserNames *users);
     void presetEntity(const QString &entity, int field);
     QString getEntity() const;
     void setUser(const QString &user);
@@ -119,6 +119,13 @@ KVirtualBGRenderer::changeWallpaper()
         m_renderer[i]->changeWallpaper();
 }
 
+void
+KVirtualBGRenderer::syncWallpaperState()
+{
+    for (int i = 0; i < m_numRenderers; i++)
+        m_renderer[i]->syncWallpaperState();
+}
+
 void
 KVirtualBGRenderer::desktopResized()
 {
@@ -292,6 +299,7 @@ void MyApplication::init(const QString &confFile)
     connect(renderer, SIGNAL(imageDone()), this, SLOT(renderDone()));
     renderer->enableTiling(true); // optimize
     renderer->changeWallpaper(); // cannot do it when we're killed, so do it now
+    renderer->syncWallpaperState();
     timer.start(60000);
     renderer->start();
 }
@@ -329,6 +337,8 @@ MyApplication::renderDone()
         XFreePixmap(dpy, dpm);
     }
 
+    // all screens share the config, so this writes it just once
+    renderer->syncWallpaperState();
     renderer->saveCacheFile();
     renderer->cleanup();
     for (unsigned i = 0; i < renderer->numRenderers(); ++i) {
@@ -51,6 +51,7 @@ class KVirtualBGRenderer : public QObject {
 
     bool needWallpaperChange();
     void changeWallpaper();
+    void syncWallpaperState();
 
     void desktopResized();
 
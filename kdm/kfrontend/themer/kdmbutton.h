@@ -36,6 +36,8 @@ public:
 
 protected:
     virtual void drawContents(QPainter *p, const QRect &r);
+    // the button is a widget
+    virtual bool isStatic() const { return true; }
 
     virtual void doPlugActions(bool plug);
 
@@ -53,6 +53,8 @@ KdmItem::KdmItem(QObject *parent, const QDomNode &node)
     , m_minScrHeight(0)
     , m_visible(true)
     , m_shown(true)
+    , m_staticLayer(false)
+    , m_hintGeneration(-1)
 {
     QDomNode showNode = node.namedItem("show");
     if (!showNode.isNull()) {
@@ -333,13 +335,21 @@ KdmItem::setGeometry(QStack<QSize> &parentSizes, const QRect &newGeometry, bool
 
     // TODO send *selective* repaint signal
 
+    bounds = area;
+    forEachVisibleChild (itm)
+        bounds |= itm->bounds;
+
     leave() << "done";
 }
 
+int KdmItem::paintCount = 0;
+
 void
-KdmItem::paint(QPainter *p, const QRect &rect, bool background, bool primaryScreen)
+KdmItem::paint(QPainter *p, const QRect &rect, bool background, bool primaryScreen,
+               PaintLayers layers)
 {
-    if (!isVisible())
+    // nothing of this subtree is in the area to paint
+    if (!isVisible() || !bounds.intersects(rect))
         return;
     if (background &&
         (p->device()->width() < m_minScrWidth ||
@@ -350,12 +360,14 @@ KdmItem::paint(QPainter *p, const QRect &rect, bool background, bool primaryScre
         return;
 
     QRect contentsRect = area.intersected(rect);
-    if (!contentsRect.isEmpty() &&
+    if ((layers == AllLayers || (layers == StaticLayer) == m_staticLayer) &&
+        !contentsRect.isEmpty() &&
         (!background || isBackground) &&
         (paintOnScreen == ScrAll ||
          ((paintOnScreen == ScrGreeter) == primaryScreen)))
     {
         drawContents(p, contentsRect);
+        paintCount++;
         if (debugLevel & DEBUG_THEMING) {
             // Draw bounding rect for this item
             QPen pen(Qt::white);
@@ -371,7 +383,21 @@ KdmItem::paint(QPainter *p, const QRect &rect, bool background, bool primaryScre
 
     // Dispatch paint events to children
     forEachChild (itm)
-        itm->paint(p, rect, background, primaryScreen);
+        itm->paint(p, rect, background, primaryScreen, layers);
+}
+
+void
+KdmItem::markStaticLayer(bool &open)
+{
+    m_staticLayer = false;
+    // neither this nor the children are painted
+    if (!isVisible() || myWidget)
+        return;
+    if (open && paintOnScreen != ScrOther && !isStatic())
+        open = false;
+    m_staticLayer = open;
+    forEachChild (itm)
+        itm->markStaticLayer(open);
 }
 
 bool
@@ -405,6 +431,16 @@ KdmItem::mouseEvent(int x, int y, bool pressed, bool released)
     if (!isVisible())
         return;
 
+    updateMouseState(x, y, pressed, released);
+
+    if (!isButton)
+        forEachChild (itm)
+            itm->mouseEvent(x, y, pressed, released);
+}
+
+void
+KdmItem::updateMouseState(int x, int y, bool pressed, bool released)
+{
     ItemState oldState = state;
     if (area.contains(x, y) || (isButton && childrenContain(x, y))) {
         if (released && oldState == Sactive) {
@@ -432,10 +468,17 @@ KdmItem::mouseEvent(int x, int y, bool pressed, bool released)
     }
     if (oldState != state)
         statusChanged(isButton);
+}
 
+void
+KdmItem::collectHitItems(QVector<KdmItem *> &items)
+{
+    if (!isVisible())
+        return;
+    items.append(this);
     if (!isButton)
         forEachChild (itm)
-            itm->mouseEvent(x, y, pressed, released);
+            itm->collectHitItems(items);
 }
 
 void
@@ -464,7 +507,16 @@ const QSize &
 KdmItem::ensureHintedSize(QSize &hintedSize)
 {
     if (!hintedSize.isValid()) {
-        hintedSize = sizeHint();
+        // widgets may change their minds any time
+        if (myWidget) {
+            hintedSize = sizeHint();
+        } else {
+            if (m_hintGeneration != KdmLayout::cacheGeneration()) {
+                m_cachedHint = sizeHint();
+                m_hintGeneration = KdmLayout::cacheGeneration();
+            }
+            hintedSize = m_cachedHint;
+        }
         debug() << "hinted" << hintedSize;
     }
     return hintedSize;
@@ -27,6 +27,7 @@
 #include <QDomNode>
 #include <QObject>
 #include <QStack>
+#include <QVector>
 
 class KdmItem;
 class KdmLayoutBox;
@@ -102,12 +103,25 @@ public:
      */
     virtual void setGeometry(QStack<QSize> &parentSizes, const QRect &newGeometry, bool force);
 
+    enum PaintLayers { AllLayers, StaticLayer, DynamicLayer };
+
     /**
      * Paint the item and its children using the given painter.
      * This is the compositing core function. It buffers paint operations
      * to speed up rendering of dynamic objects.
+     * @param layers restricts painting to the items (not) in the static
+     *  layer, see markStaticLayer()
      */
-    void paint(QPainter *painter, const QRect &boundaries, bool background, bool primaryScreen);
+    void paint(QPainter *painter, const QRect &boundaries, bool background, bool primaryScreen,
+               PaintLayers layers = AllLayers);
+
+    /**
+     * Put this item and its children into the static layer as long as
+     * @p open is set and they are static. The first item painted on the
+     * greeter screen which is not static clears @p open, as everything
+     * on top of it must be painted after it.
+     */
+    void markStaticLayer(bool &open);
 
     /**
      * Update representation of contents and repaint.
@@ -120,6 +134,23 @@ public:
      */
     void mouseEvent(int x, int y, bool pressed = false, bool released = false);
 
+    /**
+     * Update the state of this item only, as mouseEvent() would.
+     */
+    void updateMouseState(int x, int y, bool pressed, bool released);
+
+    /**
+     * Append the items mouseEvent() would visit, in the same order.
+     */
+    void collectHitItems(QVector<KdmItem *> &items);
+
+    /**
+     * The area in which the pointer affects the state of the item.
+     * For buttons this includes the children.
+     */
+    QRect hitRect() const { return isButton ? bounds : area; }
+    bool isNormal() const { return state == Snormal; }
+
     /**
      * Similar to sizeHint(..), this returns the area of the item
      * given the @p parentGeometry. The default implementation
@@ -156,6 +187,11 @@ public:
 
     QRect rect() const { return area; }
 
+    /**
+     * Number of items drawn since the last reset; for DEBUG_THEMING.
+     */
+    static int paintCount;
+
     void showStructure(const QString &pfx);
 
 Q_SIGNALS:
@@ -195,6 +231,13 @@ protected:
      */
     virtual void statusChanged(bool descend);
 
+    /**
+     * Whether the item looks the same as long as its geometry does not
+     * change. The themer caches the painting of such items at the bottom
+     * of the stack.
+     */
+    virtual bool isStatic() const { return false; }
+
     virtual void doPlugActions(bool plug);
 
     bool eventFilter(QObject *o, QEvent *e);
@@ -215,6 +258,8 @@ protected:
 
     // This is the placement of the item
     QRect area;
+    // area united with the bounds of the visible children
+    QRect bounds;
 
     QString buddy;
     bool isButton;
@@ -266,6 +311,11 @@ protected:
     int m_minScrWidth, m_minScrHeight;
 
     bool m_visible, m_shown;
+    bool m_staticLayer;
+
+    // sizeHint(), valid while the layout cache generation is unchanged
+    QSize m_cachedHint;
+    int m_hintGeneration;
 
     friend class KdmLabel; // isButton
     friend class KdmLayoutBox; // geom.expand
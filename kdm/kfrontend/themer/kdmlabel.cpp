@@ -35,6 +35,7 @@
 #include <QFontMetrics>
 #include <QHash>
 #include <QPainter>
+#include <QTime>
 #include <QTimer>
 #include <QX11Info>
 
@@ -63,6 +64,7 @@ KdmLabel::KdmLabel(QObject *parent, const QDomNode &node)
             QColor(Qt::white);
     label.active.present = false;
     label.prelight.present = false;
+    label.normal.laidOut = label.active.laidOut = label.prelight.laidOut = false;
 
     const QString locale = KGlobal::locale()->language();
 
@@ -100,8 +102,9 @@ KdmLabel::KdmLabel(QObject *parent, const QDomNode &node)
     label.isTimer = label.text.indexOf("%c") >= 0;
     if (label.isTimer) {
         timer = new QTimer(this);
-        timer->start(1000);
-        connect(timer, SIGNAL(timeout()), SLOT(update()));
+        timer->setSingleShot(true);
+        connect(timer, SIGNAL(timeout()), SLOT(slotClockTick()));
+        scheduleClockTick();
     }
 
     zeroWidth = QFontMetrics(label.normal.font.font).width('0');
@@ -143,6 +146,54 @@ KdmLabel::setCText(const QString &txt)
         emit needPlacement();
     }
     pTextIndent = bbox.left();
+    label.normal.laidOut = label.active.laidOut = label.prelight.laidOut = false;
+}
+
+/*
+ * The clock is shown without seconds, so expanding it every second would
+ * be in vain. Wake up right after each full minute instead.
+ */
+void
+KdmLabel::scheduleClockTick()
+{
+    QTime now = QTime::currentTime();
+    timer->start(60000 - now.second() * 1000 - now.msec() + 50);
+}
+
+void
+KdmLabel::slotClockTick()
+{
+    scheduleClockTick();
+    update();
+}
+
+static void
+prepareText(QStaticText &st, const QString &text, const QFont &font)
+{
+    st.setText(text);
+    st.setTextFormat(Qt::PlainText);
+    st.setPerformanceHint(QStaticText::AggressiveCaching);
+    st.prepare(QTransform(), font);
+}
+
+void
+KdmLabel::layoutText(LabelStruct::LabelClass &l)
+{
+    if (pAccelOff != -1) {
+        QFontMetrics fm(l.font.font);
+        QString left = pText.left(pAccelOff);
+        QString acc(pText[pAccelOff]);
+        QFont f(l.font.font);
+        f.setUnderline(true);
+        prepareText(l.left, left, l.font.font);
+        prepareText(l.accel, acc, f);
+        prepareText(l.right, pText.mid(pAccelOff + 1), l.font.font);
+        l.accelX = fm.width(left) - pTextIndent;
+        l.rightX = l.accelX + fm.width(acc);
+    } else {
+        prepareText(l.left, cText, l.font.font);
+    }
+    l.laidOut = true;
 }
 
 void
@@ -187,27 +238,21 @@ KdmLabel::drawContents(QPainter *p, const QRect &r)
         l = &label.active;
     else if (state == Sprelight && label.prelight.present)
         l = &label.prelight;
+    // the layout is redone only when the text changes
+    if (!l->laidOut)
+        layoutText(*l);
     // draw the label
     p->setFont(l->font.font);
     p->setPen(l->color);
     p->setClipRect(r);
+    p->drawStaticText(area.topLeft(), l->left);
     if (pAccelOff != -1) {
-        QRect tarea(area);
-        tarea.setLeft(tarea.left() - pTextIndent);
-        QFontMetrics fm(l->font.font);
-        QString left = pText.left(pAccelOff);
-        p->drawText(area, 0, left);
-        tarea.setLeft(tarea.left() + fm.width(left));
         QFont f(l->font.font);
         f.setUnderline(true);
         p->setFont(f);
-        QString acc(pText[pAccelOff]);
-        p->drawText(tarea, 0, acc);
-        tarea.setLeft(tarea.left() + fm.width(acc));
+        p->drawStaticText(area.left() + l->accelX, area.top(), l->accel);
         p->setFont(l->font.font);
-        p->drawText(tarea, 0, pText.mid(pAccelOff + 1));
-    } else {
-        p->drawText(area, 0, cText);
+        p->drawStaticText(area.left() + l->rightX, area.top(), l->right);
     }
     p->setClipping(false);
 }
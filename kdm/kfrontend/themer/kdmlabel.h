@@ -28,6 +28,7 @@
 
 #include <QColor>
 #include <QFont>
+#include <QStaticText>
 
 class QAction;
 class QTimer;
@@ -70,6 +71,10 @@ protected:
             QColor color;
             FontType font;
             bool present;
+            // pText laid out in this font, split around the accelerator
+            QStaticText left, accel, right;
+            int accelX, rightX;
+            bool laidOut;
         } normal, active, prelight;
     } label;
 
@@ -87,6 +92,8 @@ private:
     QString lookupText(const QString &t);
 
     void setCText(const QString &txt);
+    void layoutText(LabelStruct::LabelClass &l);
+    void scheduleClockTick();
 
     void updateWidgetAttribs();
 
@@ -99,6 +106,7 @@ private:
 
 private Q_SLOTS:
     void activate();
+    void slotClockTick();
 };
 
 #endif // KDMLABEL_H
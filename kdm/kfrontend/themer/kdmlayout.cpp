@@ -22,6 +22,11 @@
 #include "kdmlayout.h"
 #include "kdmitem.h"
 
+// the number of parent sizes a box remembers its layout for
+#define MAX_CACHED_LAYOUTS 4
+
+int KdmLayout::generation;
+
 KdmLayoutFixed::KdmLayoutFixed(const QDomNode &/*node*/)
 {
     //Parsing FIXED parameters on 'node' [NONE!]
@@ -57,6 +62,17 @@ KdmLayoutBox::KdmLayoutBox(const QDomNode &node)
     box.minwidth = el.attribute("min-width", "0").toInt();
     box.minheight = el.attribute("min-height", "0").toInt();
     box.homogeneous = el.attribute("homogeneous", "false") == "true";
+    cachedGeneration = generation;
+}
+
+void
+KdmLayoutBox::checkCaches()
+{
+    if (cachedGeneration != generation) {
+        layoutCache.clear();
+        hintCache.clear();
+        cachedGeneration = generation;
+    }
 }
 
 struct LayoutHint {
@@ -79,6 +95,48 @@ KdmLayoutBox::update(QStack<QSize> &parentSizes, const QRect &parentGeometry, bo
         return;
     }
 
+    int ccnt = 0;
+    forEachVisibleChild (itm)
+        ccnt++;
+
+    // The layout does not depend on the position, so it can be reused
+    // for all parents of the same size.
+    checkCaches();
+    QVector<QRect> rects;
+    foreach (const CachedLayout &cl, layoutCache)
+        if (cl.size == parentGeometry.size() && cl.parentSizes == parentSizes &&
+            cl.rects.count() == ccnt)
+        {
+            debug() << "using cached layout";
+            rects = cl.rects;
+            break;
+        }
+    if (rects.isEmpty() && ccnt) {
+        rects = layoutChildren(parentSizes, QRect(QPoint(0, 0), parentGeometry.size()));
+        if (layoutCache.count() >= MAX_CACHED_LAYOUTS)
+            layoutCache.removeFirst();
+        CachedLayout cl;
+        cl.parentSizes = parentSizes;
+        cl.size = parentGeometry.size();
+        cl.rects = rects;
+        layoutCache.append(cl);
+    }
+
+    int idx = 0;
+    parentSizes.push(parentGeometry.size());
+    forEachVisibleChild (itm)
+        itm->setGeometry(parentSizes, rects[idx++].translated(parentGeometry.topLeft()), force);
+    parentSizes.pop();
+    leave() << "done";
+}
+
+/*
+ * Compute the geometries of the visible children within @p parentGeometry.
+ */
+QVector<QRect>
+KdmLayoutBox::layoutChildren(QStack<QSize> &parentSizes, const QRect &parentGeometry)
+{
+    QVector<QRect> rects;
     QRect childrenRect = parentGeometry;
     // Begin cutting the parent rectangle to attach children on the right place
     childrenRect.adjust(box.xpadding, box.ypadding, -box.xpadding, -box.ypadding);
@@ -102,10 +160,7 @@ KdmLayoutBox::update(QStack<QSize> &parentSizes, const QRect &parentGeometry, bo
                 childrenRect.setLeft(childrenRect.left() + width + box.spacing);
             }
             parentSizes.push(temp.size());
-            QRect itemRect = itm->placementHint(parentSizes, temp.topLeft());
-            parentSizes.pop();
-            parentSizes.push(parentGeometry.size());
-            itm->setGeometry(parentSizes, itemRect, force);
+            rects.append(itm->placementHint(parentSizes, temp.topLeft()));
             parentSizes.pop();
             ccnt--;
         }
@@ -198,17 +253,31 @@ KdmLayoutBox::update(QStack<QSize> &parentSizes, const QRect &parentGeometry, bo
             parentSizes.pop();
             debug() << "placementHint for" << itm << "temp" << temp << "final"
                 << itemRect << "childrenRect now" << childrenRect;
-            parentSizes.push(parentGeometry.size());
-            itm->setGeometry(parentSizes, itemRect, force);
-            parentSizes.pop();
+            rects.append(itemRect);
             idx++;
         }
     }
-    leave() << "done";
+    return rects;
 }
 
 QSize
 KdmLayoutBox::sizeHint(QStack<QSize> &parentSizes)
+{
+    checkCaches();
+    foreach (const CachedHint &ch, hintCache)
+        if (ch.parentSizes == parentSizes)
+            return ch.hint;
+    if (hintCache.count() >= MAX_CACHED_LAYOUTS)
+        hintCache.removeFirst();
+    CachedHint ch;
+    ch.parentSizes = parentSizes;
+    ch.hint = calcSizeHint(parentSizes);
+    hintCache.append(ch);
+    return ch.hint;
+}
+
+QSize
+KdmLayoutBox::calcSizeHint(QStack<QSize> &parentSizes)
 {
     enter("Box::sizeHint") << NoSpace << "parentSize #" << parentSizes.size()
         << Space << parentSizes.top();
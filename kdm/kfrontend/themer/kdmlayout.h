@@ -22,8 +22,11 @@
 #ifndef KDMLAYOUT_H
 #define KDMLAYOUT_H
 
+#include <QList>
+#include <QRect>
 #include <QSize>
 #include <QStack>
+#include <QVector>
 
 class KdmItem;
 
@@ -45,8 +48,15 @@ public:
     // has the @p parentGeometry geometry
 //    virtual void update(QStack<QRect> &parentGeometries) = 0;
 
+    // Drops all cached size hints and layouts. Must be called whenever
+    // the contents or the visibility of any item may have changed.
+    static void invalidateCaches() { generation++; }
+    static int cacheGeneration() { return generation; }
+
 protected:
     QList<KdmItem *> m_children;
+
+    static int generation;
 };
 
 class KdmLayoutFixed : public KdmLayout {
@@ -78,6 +88,25 @@ public:
     QSize sizeHint(QStack<QSize> &parentSizes);
 
 private:
+    QVector<QRect> layoutChildren(QStack<QSize> &parentSizes, const QRect &parentGeometry);
+    QSize calcSizeHint(QStack<QSize> &parentSizes);
+    void checkCaches();
+
+    // Results for the last few parent size stacks (one per screen size,
+    // typically). The rects are relative to the parent.
+    struct CachedLayout {
+        QStack<QSize> parentSizes;
+        QSize size;
+        QVector<QRect> rects;
+    };
+    struct CachedHint {
+        QStack<QSize> parentSizes;
+        QSize hint;
+    };
+    QList<CachedLayout> layoutCache;
+    QList<CachedHint> hintCache;
+    int cachedGeneration;
+
     struct {
         bool isVertical;
         int spacing;
@@ -37,6 +37,7 @@ public:
 protected:
     // no-op
     virtual void drawContents(QPainter *p, const QRect &r);
+    virtual bool isStatic() const { return true; }
 
     virtual void setWidget(QWidget *widget);
 };
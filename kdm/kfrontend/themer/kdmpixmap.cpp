@@ -22,12 +22,18 @@
 #include "kdmpixmap.h"
 #include "kdmthemer.h"
 
+#include "bgscale.h"
+
 #include <kstandarddirs.h>
 
+#include <QCoreApplication>
 #include <QDirIterator>
 #include <QPainter>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QSignalMapper>
 #include <QSvgRenderer>
+#include <QThreadPool>
 
 #include <math.h>
 
@@ -65,6 +71,86 @@ KdmPixmap::KdmPixmap(QObject *parent, const QDomNode &node)
     }
 }
 
+KdmPixmap::~KdmPixmap()
+{
+    delete takePreload(pixmap.normal);
+    delete takePreload(pixmap.active);
+    delete takePreload(pixmap.prelight);
+}
+
+/*
+ * An image or SVG decoded in a worker thread. The item owns it and
+ * collects the result when it needs the image first, waiting for it if
+ * it is not ready yet.
+ */
+struct KdmPixmap::Preload : public QRunnable {
+    Preload(const QString &_path, bool _svg)
+        : path(_path), svg(_svg), svgRenderer(0)
+    {
+        setAutoDelete(false);
+    }
+
+    ~Preload()
+    {
+        delete svgRenderer;
+    }
+
+    virtual void run()
+    {
+        if (svg) {
+            svgRenderer = new QSvgRenderer(path);
+            // must be handed to the GUI thread from the one it lives in
+            svgRenderer->moveToThread(QCoreApplication::instance()->thread());
+        } else if (image.load(path) && image.format() != QImage::Format_ARGB32) {
+            image = image.convertToFormat(QImage::Format_ARGB32);
+        }
+        done.release();
+    }
+
+    QString path;
+    bool svg;
+    QImage image;
+    QSvgRenderer *svgRenderer;
+    QSemaphore done;
+};
+
+void
+KdmPixmap::preload()
+{
+    startPreload(pixmap.normal);
+    if (pixmap.active.present)
+        startPreload(pixmap.active);
+    if (pixmap.prelight.present)
+        startPreload(pixmap.prelight);
+}
+
+void
+KdmPixmap::startPreload(PixmapStruct::PixmapClass &pClass)
+{
+    if (pClass.preload || pClass.fullpath.isEmpty() ||
+        (pClass.svgImage ? pClass.svgRenderer != 0 : !pClass.image.isNull()))
+        return;
+    // Packages and missing base files mean choosing a file by the final
+    // size, which is not known yet. With a base file, loadPixmap() may
+    // still pick a size-specific variant; the preload is wasted then.
+    if (!pClass.svgImage && (pClass.package || !QFile::exists(pClass.fullpath)))
+        return;
+    pClass.preload = new Preload(pClass.fullpath, pClass.svgImage);
+    QThreadPool::globalInstance()->start(pClass.preload);
+}
+
+KdmPixmap::Preload *
+KdmPixmap::takePreload(PixmapStruct::PixmapClass &pClass)
+{
+    Preload *pl = pClass.preload;
+    if (pl) {
+        pClass.preload = 0;
+        // rather wait than decode the same image a second time
+        pl->done.acquire();
+    }
+    return pl;
+}
+
 void
 KdmPixmap::definePixmap(const QDomElement &el, PixmapStruct::PixmapClass &pClass)
 {
@@ -190,11 +276,16 @@ KdmPixmap::loadPixmap(PixmapStruct::PixmapClass &pClass)
             fn = pClass.fullpath;
         }
     }
-    if (!pClass.image.load(fn)) {
+    Preload *pl = takePreload(pClass);
+    if (pl && pl->path == fn && !pl->image.isNull()) {
+        pClass.image = pl->image;
+    } else if (!pClass.image.load(fn)) {
+        delete pl;
         kWarning() << "failed to load" << fn;
         pClass.fullpath.clear();
         return false;
     }
+    delete pl;
     if (pClass.image.format() != QImage::Format_ARGB32)
         pClass.image = pClass.image.convertToFormat(QImage::Format_ARGB32);
     applyTint(pClass, pClass.image);
@@ -208,7 +299,14 @@ KdmPixmap::loadSvg(PixmapStruct::PixmapClass &pClass)
         return true;
     if (pClass.fullpath.isEmpty())
         return false;
-    pClass.svgRenderer = new QSvgRenderer(pClass.fullpath, this);
+    if (Preload *pl = takePreload(pClass)) {
+        pClass.svgRenderer = pl->svgRenderer;
+        pl->svgRenderer = 0;
+        pClass.svgRenderer->setParent(this);
+        delete pl;
+    } else {
+        pClass.svgRenderer = new QSvgRenderer(pClass.fullpath, this);
+    }
     if (!pClass.svgRenderer->isValid()) {
         delete pClass.svgRenderer;
         pClass.svgRenderer = 0;
@@ -290,8 +388,7 @@ KdmPixmap::drawContents(QPainter *p, const QRect &r)
                     goto noop;
                 scaledImage =
                     (area.size() != pClass.image.size()) ?
-                        pClass.image.scaled(pClass.targetArea.size(),
-                                            Qt::IgnoreAspectRatio, Qt::SmoothTransformation) :
+                        smoothScale(pClass.image, pClass.targetArea.size()) :
                         pClass.image;
             }
         }
@@ -367,4 +464,14 @@ KdmPixmap::statusChanged(bool descend)
     needUpdate();
 }
 
+bool
+KdmPixmap::isStatic() const
+{
+    if (pixmap.active.present || pixmap.prelight.present)
+        return false;
+    // the renderer exists only once the image was painted; the first
+    // animation frame invalidates the cache, and we are found out then
+    return !pixmap.normal.svgRenderer || !pixmap.normal.svgRenderer->animated();
+}
+
 #include "moc_kdmpixmap.cpp"
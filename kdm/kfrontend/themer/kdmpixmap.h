@@ -39,6 +39,10 @@ class KdmPixmap : public KdmItem {
 
 public:
     KdmPixmap(QObject *parent, const QDomNode &node);
+    ~KdmPixmap();
+
+    // start decoding the images in the background
+    void preload();
 
 protected:
     // reimplemented; returns the size of loaded pixmap
@@ -50,16 +54,21 @@ protected:
     // handle switching between normal / active / prelight configurations
     virtual void statusChanged(bool descend);
 
+    virtual bool isStatic() const;
+
     virtual void setGeometry(QStack<QSize> &parentSizes, const QRect &newGeometry, bool force);
 
+    struct Preload;
+
     struct PixmapStruct {
         struct PixmapClass {
             PixmapClass()
-                : svgRenderer(0), present(false), svgImage(false), package(false),
+                : svgRenderer(0), preload(0), present(false), svgImage(false), package(false),
                   aspectMode(Qt::IgnoreAspectRatio) {}
             QString fullpath;
             QImage image;
             QSvgRenderer *svgRenderer;
+            Preload *preload;
             QPixmap readyPixmap;
             QRect targetArea;
             QColor tint;
@@ -81,6 +90,8 @@ private:
                            const QRect &area, Qt::AspectRatioMode aspectMode);
     bool loadPixmap(PixmapStruct::PixmapClass &pc);
     bool loadSvg(PixmapStruct::PixmapClass &pc);
+    void startPreload(PixmapStruct::PixmapClass &pc);
+    Preload *takePreload(PixmapStruct::PixmapClass &pc);
     bool calcTargetArea(PixmapStruct::PixmapClass &pClass, const QSize &sh);
     void applyTint(PixmapStruct::PixmapClass &pClass, QImage &img);
     PixmapStruct::PixmapClass &getClass(ItemState sts);
@@ -82,4 +82,10 @@ KdmRect::statusChanged(bool descend)
     needUpdate();
 }
 
+bool
+KdmRect::isStatic() const
+{
+    return !rect.active.present && !rect.prelight.present;
+}
+
 #include "moc_kdmrect.cpp"
@@ -43,6 +43,8 @@ protected:
     // handle switching between normal / active / prelight configurations
     virtual void statusChanged(bool descend);
 
+    virtual bool isStatic() const;
+
     struct RectStruct {
         struct RectClass {
             QColor color;
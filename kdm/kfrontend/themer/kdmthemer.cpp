@@ -26,6 +26,7 @@
 #include "kdmlist.h"
 #include "kdmlabel.h"
 #include "kdmbutton.h"
+#include "kdmlayout.h"
 
 #include <kdm_greet.h> // debug stuff
 #include <kfdialog.h> // kfmsgbox
@@ -43,6 +44,14 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+
+// beyond this, painting the bounding rect at once is cheaper
+#define MAX_PAINT_RECTS 8
+
+// size of the cells of the hit-testing grid, as a power of two
+#define HIT_CELL_SHIFT 6
+
 /*
  * KdmThemer. The main theming interface
  */
@@ -53,6 +62,10 @@ KdmThemer::KdmThemer(const QString &_filename,
     , rootItem(0)
     , m_geometryOutdated(true)
     , m_geometryInvalid(true)
+    , m_hitCols(0)
+    , m_hitRows(0)
+    , m_hitIndexValid(false)
+    , m_staticLayerValid(false)
     , m_widget(0)
 {
     // read the XML file and create DOM tree
@@ -86,6 +99,10 @@ KdmThemer::KdmThemer(const QString &_filename,
     basedir = QFileInfo(filename).absolutePath();
 
     generateItems(rootItem, theme);
+
+    // decode the images while the rest of the greeter is set up
+    foreach (KdmPixmap *pixmap, rootItem->findChildren<KdmPixmap *>())
+        pixmap->preload();
 }
 
 KdmThemer::~KdmThemer()
@@ -113,7 +130,10 @@ KdmThemer::findNode(const QString &item) const
 void
 KdmThemer::slotNeedPlacement()
 {
+    // something changed its size or visibility
+    KdmLayout::invalidateCaches();
     m_geometryOutdated = m_geometryInvalid = true;
+    m_hitIndexValid = m_staticLayerValid = false;
     if (widget())
         widget()->update();
 }
@@ -128,6 +148,11 @@ KdmThemer::slotNeedPlugging()
 void
 KdmThemer::update(int x, int y, int w, int h)
 {
+    KdmItem *itm = qobject_cast<KdmItem *>(sender());
+    if (itm && itm->m_staticLayer)
+        m_staticLayerValid = false;
+    // this only adds to the widget's dirty region; all areas invalidated
+    // until the next paint event are painted with it
     if (widget())
         widget()->update(x, y, w, h);
 }
@@ -142,18 +167,19 @@ KdmThemer::widgetEvent(QEvent *e)
     switch (e->type()) {
     case QEvent::MouseMove: {
         QMouseEvent *me = static_cast<QMouseEvent *>(e);
-        rootItem->mouseEvent(me->x(), me->y());
+        mouseEvent(me->x(), me->y(), false, false);
         break; }
     case QEvent::MouseButtonPress: {
         QMouseEvent *me = static_cast<QMouseEvent *>(e);
-        rootItem->mouseEvent(me->x(), me->y(), true);
+        mouseEvent(me->x(), me->y(), true, false);
         break; }
     case QEvent::MouseButtonRelease: {
         QMouseEvent *me = static_cast<QMouseEvent *>(e);
-        rootItem->mouseEvent(me->x(), me->y(), false, true);
+        mouseEvent(me->x(), me->y(), false, true);
         break; }
     case QEvent::Resize:
         m_geometryOutdated = true;
+        m_hitIndexValid = m_staticLayerValid = false;
         widget()->update();
         break;
     case QEvent::Paint:
@@ -165,13 +191,30 @@ KdmThemer::widgetEvent(QEvent *e)
             if (debugLevel & DEBUG_THEMING)
                 showStructure();
             m_geometryOutdated = m_geometryInvalid = false;
+            m_staticLayerValid = false;
+            rebuildHitIndex();
         }
+        if (!m_staticLayerValid)
+            rebuildStaticLayer();
         {
-            QRect paintRect = static_cast<QPaintEvent *>(e)->rect();
-            //kDebug() << "paint on: " << paintRect;
+            // Paint the dirty rects one by one rather than their bounding
+            // rect, so a clock label in one corner and a prelit button in
+            // another do not drag in everything between them.
+            const QRegion &region = static_cast<QPaintEvent *>(e)->region();
+            QVector<QRect> rects = region.rects();
+            if (rects.count() > MAX_PAINT_RECTS)
+                rects = QVector<QRect>() << region.boundingRect();
+            //kDebug() << "paint on: " << rects;
 
             QPainter p(widget());
-            rootItem->paint(&p, paintRect, false, true);
+            KdmItem::paintCount = 0;
+            foreach (const QRect &paintRect, rects) {
+                if (!m_staticLayer.isNull())
+                    p.drawImage(paintRect, m_staticLayer, paintRect);
+                rootItem->paint(&p, paintRect, false, true, KdmItem::DynamicLayer);
+            }
+            if (debugLevel & DEBUG_THEMING)
+                debug() << "painted" << KdmItem::paintCount << "items in" << rects;
             rootItem->showWidget();
         }
         break;
@@ -180,10 +223,90 @@ KdmThemer::widgetEvent(QEvent *e)
     }
 }
 
+void
+KdmThemer::mouseEvent(int x, int y, bool pressed, bool released)
+{
+    int cx = x >> HIT_CELL_SHIFT, cy = y >> HIT_CELL_SHIFT;
+    if (!m_hitIndexValid || pressed || released ||
+        x < 0 || y < 0 || cx >= m_hitCols || cy >= m_hitRows)
+    {
+        // Clicks may depend on items which are not hit, so they take the
+        // full walk. They are rare enough.
+        rootItem->mouseEvent(x, y, pressed, released);
+        if (m_hitIndexValid)
+            findLitItems();
+        return;
+    }
+
+    // Motion changes only the items under the pointer and those which
+    // are still lit up.
+    QVector<int> todo = m_litItems + m_hitGrid[cy * m_hitCols + cx];
+    std::sort(todo.begin(), todo.end());
+    todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+    m_litItems.clear();
+    foreach (int i, todo) {
+        KdmItem *itm = m_hitItems[i];
+        itm->updateMouseState(x, y, false, false);
+        if (!itm->isNormal())
+            m_litItems.append(i);
+    }
+}
+
+void
+KdmThemer::findLitItems()
+{
+    m_litItems.clear();
+    for (int i = 0; i < m_hitItems.count(); i++)
+        if (!m_hitItems[i]->isNormal())
+            m_litItems.append(i);
+}
+
+/* Called after every layout, as it depends on the geometry and visibility */
+void
+KdmThemer::rebuildHitIndex()
+{
+    m_hitItems.clear();
+    rootItem->collectHitItems(m_hitItems);
+
+    QRect wrect(QPoint(0, 0), widget()->size());
+    m_hitCols = (wrect.width() >> HIT_CELL_SHIFT) + 1;
+    m_hitRows = (wrect.height() >> HIT_CELL_SHIFT) + 1;
+    m_hitGrid.clear();
+    m_hitGrid.resize(m_hitCols * m_hitRows);
+    for (int i = 0; i < m_hitItems.count(); i++) {
+        QRect r = m_hitItems[i]->hitRect().intersected(wrect);
+        if (r.isEmpty())
+            continue;
+        for (int cy = r.top() >> HIT_CELL_SHIFT; cy <= r.bottom() >> HIT_CELL_SHIFT; cy++)
+            for (int cx = r.left() >> HIT_CELL_SHIFT; cx <= r.right() >> HIT_CELL_SHIFT; cx++)
+                m_hitGrid[cy * m_hitCols + cx].append(i);
+    }
+    findLitItems();
+    m_hitIndexValid = true;
+}
+
+void
+KdmThemer::rebuildStaticLayer()
+{
+    bool open = true;
+    rootItem->markStaticLayer(open);
+    m_staticLayerValid = true;
+
+    // Items are composited with "source over", which is associative, so
+    // painting the layer over the widget background gives the same result
+    // as painting the items one by one.
+    m_staticLayer = QImage(widget()->size(), QImage::Format_ARGB32_Premultiplied);
+    m_staticLayer.fill(0);
+    QPainter p(&m_staticLayer);
+    rootItem->paint(&p, m_staticLayer.rect(), false, true, KdmItem::StaticLayer);
+}
+
 void
 KdmThemer::paintBackground(QPainter *p, const QRect &rect, bool primaryScreen)
 {
     debug() << "==== setting background geometry ====";
+    m_geometryOutdated = true;
+    m_hitIndexValid = m_staticLayerValid = false;
     QStack<QSize> ps;
     rootItem->setGeometry(ps, rect, true);
     rootItem->paint(p, rect, true, primaryScreen);
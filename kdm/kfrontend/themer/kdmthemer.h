@@ -22,8 +22,10 @@
 #ifndef KDMTHEMER_H
 #define KDMTHEMER_H
 
+#include <QImage>
 #include <QMap>
 #include <QObject>
+#include <QVector>
 
 class KdmItem;
 
@@ -92,6 +94,26 @@ private:
     bool m_geometryOutdated;
     bool m_geometryInvalid;
 
+    /*
+     * Grid of 64x64 pixel cells listing the items whose hit area
+     * touches them, so pointer motion needs to look only at the items
+     * under the pointer and at those which are not in normal state.
+     * Indices are into m_hitItems, which is in mouseEvent() order.
+     */
+    QVector<KdmItem *> m_hitItems;
+    QVector<QVector<int> > m_hitGrid;
+    QVector<int> m_litItems;
+    int m_hitCols, m_hitRows;
+    bool m_hitIndexValid;
+
+    /*
+     * The items at the bottom of the stack which never change their
+     * looks, flattened. Rebuilt after layouts and when one of them asks
+     * for a repaint anyway.
+     */
+    QImage m_staticLayer;
+    bool m_staticLayerValid;
+
     QWidget *m_widget;
 
     // methods
@@ -105,6 +127,11 @@ private:
 
     void showStructure();
 
+    void rebuildHitIndex();
+    void rebuildStaticLayer();
+    void findLitItems();
+    void mouseEvent(int x, int y, bool pressed, bool released);
+
 private Q_SLOTS:
     void update(int x, int y, int w, int h);
     void slotNeedPlugging();
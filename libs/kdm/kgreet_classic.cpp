@@ -23,10 +23,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "kgreet_classic.h"
+#include "kgreeterusers.h"
 
 #include <klocalizedstring.h>
 #include <klineedit.h>
-#include <kcompletion.h>
 #include <kuser.h>
 
 #include <QRegExp>
@@ -143,8 +143,14 @@ KClassicGreeter::~KClassicGreeter()
 void // virtual
 KClassicGreeter::loadUsers(const QStringList &users)
 {
-    KCompletion *userNamesCompletion = new KCompletion;
-    userNamesCompletion->setItems(users);
+    ownUsers.insert(users);
+    loadUserStore(&ownUsers);
+}
+
+void // virtual
+KClassicGreeter::loadUserStore(const KGreeterUserNames *users)
+{
+    KCompletion *userNamesCompletion = new KGreeterUserCompletion(users);
     loginEdit->setCompletionObject(userNamesCompletion);
     loginEdit->setAutoDeleteCompletionObject(true);
     loginEdit->setCompletionMode(KCompletion::CompletionAuto);
@@ -473,7 +479,8 @@ create(KGreeterPluginHandler *handler,
 
 KDE_EXPORT KGreeterPluginInfo kgreeterplugin_info = {
     I18N_NOOP2("@item:inmenu authentication method", "Username + password (classic)"), "classic",
-    KGreeterPluginInfo::Local | KGreeterPluginInfo::Presettable,
+    KGreeterPluginInfo::Local | KGreeterPluginInfo::Presettable |
+        KGreeterPluginInfo::UserStore,
     init, done, create
 };
 
@@ -44,6 +44,7 @@ class KClassicGreeter : public QObject, public KGreeterPlugin {
                     Function func, Context ctx);
     ~KClassicGreeter();
     virtual void loadUsers(const QStringList &users);
+    virtual void loadUserStore(const KGreeterUserNames *users);
     virtual void presetEntity(const QString &entity, int field);
     virtual QString getEntity() const;
     virtual void setUser(const QString &user);
@@ -75,6 +76,7 @@ class KClassicGreeter : public QObject, public KGreeterPlugin {
     KLineEdit *passwdEdit, *passwd1Edit, *passwd2Edit;
     KSimpleConfig *stsFile;
     QString fixedUser, curUser;
+    KGreeterUserNames ownUsers; // for loadUsers()
     Function func;
     Context ctx;
     int exp, pExp, has;
@@ -27,10 +27,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "kgreet_generic.h"
+#include "kgreeterusers.h"
 
 #include <klocalizedstring.h>
 #include <klineedit.h>
-#include <kcompletion.h>
 #include <kuser.h>
 
 #include <QLayout>
@@ -60,6 +60,7 @@ KGenericGreeter::KGenericGreeter(KGreeterPluginHandler *_handler,
     QObject(),
     KGreeterPlugin(_handler),
     m_lineEdit(0),
+    m_users(0),
     fixedUser(_fixedEntity),
     func(_func),
     ctx(_ctx),
@@ -86,6 +87,13 @@ KGenericGreeter::~KGenericGreeter()
 
 void // virtual
 KGenericGreeter::loadUsers(const QStringList &users)
+{
+    ownUsers.insert(users);
+    loadUserStore(&ownUsers);
+}
+
+void // virtual
+KGenericGreeter::loadUserStore(const KGreeterUserNames *users)
 {
     m_users = users;
 }
@@ -177,9 +185,8 @@ KGenericGreeter::textPrompt(const char *prompt, bool echo, bool /* nonBlocking *
         m_lineEdit = new KLineEdit;
         m_lineEdit->setContextMenuPolicy(Qt::NoContextMenu);
         if (!exp) {
-            if (!m_users.isEmpty()) {
-                KCompletion *userNamesCompletion = new KCompletion;
-                userNamesCompletion->setItems(m_users);
+            if (m_users) {
+                KCompletion *userNamesCompletion = new KGreeterUserCompletion(m_users);
                 m_lineEdit->setCompletionObject(userNamesCompletion);
                 m_lineEdit->setAutoDeleteCompletionObject(true);
                 m_lineEdit->setCompletionMode(KCompletion::CompletionAuto);
@@ -348,7 +355,7 @@ create(KGreeterPluginHandler *handler,
 
 KDE_EXPORT KGreeterPluginInfo kgreeterplugin_info = {
     I18N_NOOP2("@item:inmenu authentication method", "Generic"), "generic",
-    KGreeterPluginInfo::Local,
+    KGreeterPluginInfo::Local | KGreeterPluginInfo::UserStore,
     init, done, create
 };
 
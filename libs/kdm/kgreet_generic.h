@@ -46,6 +46,7 @@ class KGenericGreeter : public QObject, public KGreeterPlugin {
                     Function func, Context ctx);
     ~KGenericGreeter();
     virtual void loadUsers(const QStringList &users);
+    virtual void loadUserStore(const KGreeterUserNames *users);
     virtual void presetEntity(const QString &entity, int field);
     virtual QString getEntity() const;
     virtual void setUser(const QString &user);
@@ -74,7 +75,8 @@ class KGenericGreeter : public QObject, public KGreeterPlugin {
     QWidget *m_parentWidget;
     QList<QString> m_infoMsgs;
     QString fixedUser, curUser;
-    QStringList m_users;
+    const KGreeterUserNames *m_users;
+    KGreeterUserNames ownUsers; // for loadUsers()
     Function func;
     Context ctx;
     int exp, m_line;
@@ -23,12 +23,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "kgreet_winbind.h"
+#include "kgreeterusers.h"
 
 #include <klocalizedstring.h>
 #include <kdebug.h>
 #include <kcombobox.h>
 #include <klineedit.h>
-#include <kcompletion.h>
 #include <kuser.h>
 #include <kprocess.h>
 
@@ -37,10 +37,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QLabel>
 #include <QContextMenuEvent>
 #include <QGridLayout>
-#include <QTextStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
 
 #include <stdlib.h>
-#include <stdio.h>
+#include <sys/types.h>
+#include <utime.h>
 
 static int echoMode;
 
@@ -59,6 +63,7 @@ public:
 static char separator;
 static QStringList staticDomains;
 static QString defaultDomain;
+static KWinbindDomains *domainLister;
 
 static void
 splitEntity(const QString &ent, QString &dom, QString &usr)
@@ -76,6 +81,7 @@ KWinbindGreeter::KWinbindGreeter(KGreeterPluginHandler *_handler,
                                  Function _func, Context _ctx) :
     QObject(),
     KGreeterPlugin(_handler),
+    userCompletion(0),
     func(_func),
     ctx(_ctx),
     exp(-1),
@@ -137,7 +143,10 @@ KWinbindGreeter::KWinbindGreeter(KGreeterPluginHandler *_handler,
             connect(loginEdit, SIGNAL(textChanged(QString)), SLOT(slotChanged()));
             connect(loginEdit, SIGNAL(selectionChanged()), SLOT(slotChanged()));
             domainCombo->addItems(staticDomains);
-            QTimer::singleShot(0, this, SLOT(slotStartDomainList()));
+            connect(domainLister, SIGNAL(changed(QStringList)),
+                    SLOT(slotDomainsChanged(QStringList)));
+            slotDomainsChanged(domainLister->domains());
+            domainLister->ref();
         } else if (ctx != Login && ctx != Shutdown && grid) {
             domainLabel = new QLabel(i18n("Domain:"), parent);
             grid->addWidget(domainLabel, line, 0);
@@ -190,6 +199,8 @@ KWinbindGreeter::KWinbindGreeter(KGreeterPluginHandler *_handler,
 // virtual
 KWinbindGreeter::~KWinbindGreeter()
 {
+    if (domainCombo)
+        domainLister->deref();
     abort();
     qDeleteAll(widgetList);
 }
@@ -197,28 +208,26 @@ KWinbindGreeter::~KWinbindGreeter()
 void
 KWinbindGreeter::slotChangedDomain(const QString &dom)
 {
-    if (!loginEdit->completionObject())
+    if (!userCompletion)
         return;
-    QStringList users;
-    if (dom == "<local>") {
-        for (QStringList::ConstIterator it = allUsers.constBegin(); it != allUsers.constEnd(); ++it)
-            if ((*it).indexOf(separator) < 0)
-                users << *it;
-    } else {
-        QString st(dom + separator);
-        for (QStringList::ConstIterator it = allUsers.constBegin(); it != allUsers.constEnd(); ++it)
-            if ((*it).startsWith(st))
-                users << (*it).mid(st.length());
-    }
-    loginEdit->completionObject()->setItems(users);
+    if (dom == "<local>")
+        userCompletion->setFilter(QString(), QLatin1Char(separator));
+    else
+        userCompletion->setFilter(dom + separator);
 }
 
 void // virtual
 KWinbindGreeter::loadUsers(const QStringList &users)
 {
-    allUsers = users;
-    KCompletion *userNamesCompletion = new KCompletion;
-    loginEdit->setCompletionObject(userNamesCompletion);
+    ownUsers.insert(users);
+    loadUserStore(&ownUsers);
+}
+
+void // virtual
+KWinbindGreeter::loadUserStore(const KGreeterUserNames *users)
+{
+    userCompletion = new KGreeterUserCompletion(users);
+    loginEdit->setCompletionObject(userCompletion);
     loginEdit->setAutoDeleteCompletionObject(true);
     loginEdit->setCompletionMode(KCompletion::CompletionAuto);
     slotChangedDomain(defaultDomain);
@@ -539,29 +548,13 @@ KWinbindGreeter::slotChanged()
 }
 
 void
-KWinbindGreeter::slotStartDomainList()
-{
-    m_domainLister = new KProcess(this);
-    (*m_domainLister) << "wbinfo" << "--own-domain" << "--trusted-domains";
-    m_domainLister->setOutputChannelMode(KProcess::OnlyStdoutChannel);
-    connect(m_domainLister, SIGNAL(finished(int,QProcess::ExitStatus)),
-            SLOT(slotEndDomainList()));
-    m_domainLister->start();
-}
-
-void
-KWinbindGreeter::slotEndDomainList()
+KWinbindGreeter::slotDomainsChanged(const QStringList &domains)
 {
     QStringList domainList;
 
-    while (!m_domainLister->atEnd()) {
-        QString dom = m_domainLister->readLine();
-        dom.chop(1);
+    foreach (const QString &dom, domains)
         if (!staticDomains.contains(dom))
             domainList.append(dom);
-    }
-
-    delete m_domainLister;
 
     for (int i = domainCombo->count(), min = staticDomains.count(); --i >= min;) {
         int dli = domainList.indexOf(domainCombo->itemText(i));
@@ -574,8 +567,162 @@ KWinbindGreeter::slotEndDomainList()
         }
     }
     domainCombo->addItems(domainList);
+}
+
+// domain list provider
+
+KWinbindDomains::KWinbindDomains(const QString &cacheFile, int ttl,
+                                 bool needSeparator) :
+    QObject(),
+    m_cacheFile(cacheFile),
+    m_lister(0),
+    m_ttl(qMax(ttl, 1)),
+    m_refs(0),
+    m_needSeparator(needSeparator)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), SLOT(slotRefresh()));
+    // a cached separator is good enough to start with
+    readCache();
+}
+
+void
+KWinbindDomains::ref()
+{
+    if (!m_refs++ && !m_lister)
+        m_timer.start(0);
+}
+
+void
+KWinbindDomains::deref()
+{
+    if (!--m_refs)
+        m_timer.stop();
+}
+
+bool
+KWinbindDomains::readCache()
+{
+    if (m_cacheFile.isEmpty())
+        return false;
+    QFile f(m_cacheFile);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    QStringList lines = QString::fromLocal8Bit(f.readAll()).split('\n');
+    if (lines.isEmpty())
+        return false;
+    QString sep = lines.takeFirst();
+    if (m_needSeparator && !sep.isEmpty()) {
+        separator = sep[0].toLatin1();
+        m_needSeparator = false;
+    }
+    lines.removeAll(QString());
+    setDomains(lines);
+    return true;
+}
+
+void
+KWinbindDomains::writeCache()
+{
+    if (m_cacheFile.isEmpty())
+        return;
+    QSaveFile f(m_cacheFile);
+    if (!f.open(QIODevice::WriteOnly))
+        return;
+    QByteArray data(1, separator);
+    data += '\n';
+    foreach (const QString &dom, m_domains)
+        data += dom.toLocal8Bit() + '\n';
+    f.write(data);
+    f.commit();
+}
+
+void
+KWinbindDomains::setDomains(const QStringList &domains)
+{
+    if (domains != m_domains) {
+        m_domains = domains;
+        emit changed(m_domains);
+    }
+}
+
+void
+KWinbindDomains::slotRefresh()
+{
+    if (!m_cacheFile.isEmpty()) {
+        QFileInfo fi(m_cacheFile);
+        if (fi.exists()) {
+            qint64 age = fi.lastModified().secsTo(QDateTime::currentDateTime());
+            if (age >= 0 && age < m_ttl && readCache()) {
+                m_timer.start((m_ttl - age) * 1000);
+                return;
+            }
+            // claim the refresh, so other greeters keep using the cache
+            utime(QFile::encodeName(m_cacheFile).constData(), 0);
+        }
+    }
+    if (m_needSeparator) {
+        startLister(SLOT(slotEndSeparator()));
+        (*m_lister) << "wbinfo" << "--separator";
+    } else {
+        startLister(SLOT(slotEndDomainList()));
+        (*m_lister) << "wbinfo" << "--own-domain" << "--trusted-domains";
+    }
+    m_lister->start();
+}
 
-    QTimer::singleShot(5 * 1000, this, SLOT(slotStartDomainList()));
+void
+KWinbindDomains::startLister(const char *slot)
+{
+    m_lister = new KProcess(this);
+    m_lister->setOutputChannelMode(KProcess::OnlyStdoutChannel);
+    connect(m_lister, SIGNAL(finished(int,QProcess::ExitStatus)), slot);
+    connect(m_lister, SIGNAL(error(QProcess::ProcessError)),
+            SLOT(slotListerError(QProcess::ProcessError)));
+}
+
+void
+KWinbindDomains::slotListerError(QProcess::ProcessError error)
+{
+    if (error == QProcess::FailedToStart) {
+        m_lister->deleteLater();
+        m_lister = 0;
+        if (m_refs)
+            m_timer.start(m_ttl * 1000);
+    }
+}
+
+void
+KWinbindDomains::slotEndSeparator()
+{
+    QString sep = QString::fromLocal8Bit(m_lister->readLine()).trimmed();
+    if (!m_lister->exitCode() && !sep.isEmpty())
+        separator = sep[0].toLatin1();
+    m_needSeparator = false;
+    m_lister->deleteLater();
+
+    startLister(SLOT(slotEndDomainList()));
+    (*m_lister) << "wbinfo" << "--own-domain" << "--trusted-domains";
+    m_lister->start();
+}
+
+void
+KWinbindDomains::slotEndDomainList()
+{
+    QStringList domainList;
+
+    while (!m_lister->atEnd()) {
+        QString dom = m_lister->readLine();
+        dom.chop(1);
+        domainList.append(dom);
+    }
+    m_lister->deleteLater();
+    m_lister = 0;
+
+    setDomains(domainList);
+    writeCache();
+    if (m_refs)
+        m_timer.start(m_ttl * 1000);
 }
 
 // factory
@@ -592,18 +739,17 @@ static bool init(const QString &,
     defaultDomain = getConf(ctx, "winbind.DefaultDomain", QVariant(staticDomains.first())).toString();
     if (!defaultDomain.isEmpty() && !staticDomains.contains(defaultDomain))
         staticDomains.prepend(defaultDomain);
+    // if not configured, the separator is looked up along with the domains
     QString sepstr = getConf(ctx, "winbind.Separator", QVariant(QString())).toString();
-    if (sepstr.isNull()) {
-        FILE *sepfile = popen("wbinfo --separator 2>/dev/null", "r");
-        if (sepfile) {
-            QTextStream(sepfile) >> sepstr;
-            if (pclose(sepfile))
-                sepstr = "\\";
-        } else {
-            sepstr = "\\";
-        }
-    }
-    separator = sepstr[0].toLatin1();
+    separator = sepstr.isEmpty() ? '\\' : sepstr[0].toLatin1();
+
+    QString cacheFile;
+    QString dataDir = getConf(ctx, "DataDir", QVariant(QString())).toString();
+    if (!dataDir.isEmpty())
+        cacheFile = dataDir + "/winbind-domains";
+    domainLister = new KWinbindDomains(cacheFile,
+        getConf(ctx, "winbind.DomainListTTL", QVariant(30)).toInt(),
+        sepstr.isEmpty());
 
     KLocalizedString::setApplicationDomain("kgreet_winbind");
     return true;
@@ -613,6 +759,8 @@ static void done(void)
 {
 //     KGlobal::locale()->removeCatalog("kgreet_winbind");
     // avoid static deletion problems ... hopefully
+    delete domainLister;
+    domainLister = 0;
     staticDomains.clear();
     defaultDomain.clear();
 }
@@ -629,7 +777,8 @@ create(KGreeterPluginHandler *handler,
 
 KDE_EXPORT KGreeterPluginInfo kgreeterplugin_info = {
     I18N_NOOP2("@item:inmenu authentication method", "Winbind / Samba"), "classic",
-    KGreeterPluginInfo::Local | KGreeterPluginInfo::Fielded | KGreeterPluginInfo::Presettable,
+    KGreeterPluginInfo::Local | KGreeterPluginInfo::Fielded | KGreeterPluginInfo::Presettable |
+        KGreeterPluginInfo::UserStore,
     init, done, create
 };
 
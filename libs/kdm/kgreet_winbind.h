@@ -29,14 +29,54 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "kgreeterplugin.h"
 
 #include <QObject>
+#include <QProcess>
+#include <QStringList>
 #include <QtCore/QTimer>
 
 class KComboBox;
+class KGreeterUserCompletion;
 class KLineEdit;
 class KSimpleConfig;
 class QLabel;
 class KProcess;
 
+/*
+ * Lists the winbind domains for all greeter instances. The list is
+ * cached in a file shared by the greeters of all displays, so wbinfo
+ * is run only once per refresh interval.
+ */
+class KWinbindDomains : public QObject {
+    Q_OBJECT
+
+  public:
+    KWinbindDomains(const QString &cacheFile, int ttl, bool needSeparator);
+    const QStringList &domains() const { return m_domains; }
+    void ref();
+    void deref();
+
+  Q_SIGNALS:
+    void changed(const QStringList &domains);
+
+  private Q_SLOTS:
+    void slotRefresh();
+    void slotEndSeparator();
+    void slotEndDomainList();
+    void slotListerError(QProcess::ProcessError error);
+
+  private:
+    bool readCache();
+    void writeCache();
+    void setDomains(const QStringList &domains);
+    void startLister(const char *slot);
+
+    QString m_cacheFile;
+    QStringList m_domains;
+    QTimer m_timer;
+    KProcess *m_lister;
+    int m_ttl, m_refs;
+    bool m_needSeparator;
+};
+
 class KWinbindGreeter : public QObject, public KGreeterPlugin {
     Q_OBJECT
 
@@ -47,6 +87,7 @@ class KWinbindGreeter : public QObject, public KGreeterPlugin {
                     Function func, Context ctx);
     ~KWinbindGreeter();
     virtual void loadUsers(const QStringList &users);
+    virtual void loadUserStore(const KGreeterUserNames *users);
     virtual void presetEntity(const QString &entity, int field);
     virtual QString getEntity() const;
     virtual void setUser(const QString &user);
@@ -68,8 +109,7 @@ class KWinbindGreeter : public QObject, public KGreeterPlugin {
     void slotLoginLostFocus();
     void slotChangedDomain(const QString &dom);
     void slotChanged();
-    void slotStartDomainList();
-    void slotEndDomainList();
+    void slotDomainsChanged(const QStringList &domains);
 
   private:
     void setActive(bool enable);
@@ -82,8 +122,8 @@ class KWinbindGreeter : public QObject, public KGreeterPlugin {
     KLineEdit *passwdEdit, *passwd1Edit, *passwd2Edit;
     KSimpleConfig *stsFile;
     QString fixedDomain, fixedUser, curUser;
-    QStringList allUsers;
-    KProcess* m_domainLister;
+    KGreeterUserCompletion *userCompletion;
+    KGreeterUserNames ownUsers; // for loadUsers()
 
     Function func;
     Context ctx;
@@ -24,6 +24,8 @@
 #ifndef KGREETERPLUGIN_H
 #define KGREETERPLUGIN_H
 
+#include "kgreeterusers.h"
+
 #include <QVariant>
 #include <QMessageBox>
 #include <kdemacros.h>
@@ -129,6 +131,7 @@ public:
      * Provide the talker with a list of selectable users. This can be used
      * for autocompletion, etc.
      * Will be called only when not running.
+     * Talkers with the UserStore capability get loadUserStore() instead.
      * @param users the users to load.
      */
     virtual void loadUsers(const QStringList &users) = 0;
@@ -286,6 +289,18 @@ public:
      */
     virtual void clear() = 0;
 
+    /**
+     * Like loadUsers(), but the users are served from a shared store.
+     * Called instead of loadUsers() only if the talker has the UserStore
+     * capability, so talkers built before this method existed are never
+     * asked for it.
+     * @param users the users to load. The store is owned by the greeter
+     *  and outlives the talker; it may still grow while the users are
+     *  being enumerated, so do not copy it. See kgreeterusers.h.
+     */
+    virtual void loadUserStore(const KGreeterUserNames *users)
+        { loadUsers(users->toStringList()); }
+
     typedef QList<QWidget *> WidgetList;
 
     /**
@@ -332,7 +347,11 @@ struct KDE_EXPORT KGreeterPluginInfo {
          * This also means that setUser/gplugSetUser can be used and a
          * userlist can be shown at all - provided Local is set as well.
          */
-        Presettable = 4
+        Presettable = 4,
+        /**
+         * The talker implements loadUserStore().
+         */
+        UserStore = 8
     };
 
     /*
@@ -348,8 +367,9 @@ struct KDE_EXPORT KGreeterPluginInfo {
      *  above, it can ignore this parameter.
      * @param getConf can be used to obtain configuration items from the
      *  greeter; you have to pass it the @p ctx pointer.
-     *   The only predefined key (in KDM) is "EchoMode", which is an int
-     *   (in fact, QLineEdit::EchoModes).
+     *   The predefined keys (in KDM) are "EchoMode", which is an int
+     *   (in fact, QLineEdit::EchoModes), and "DataDir", a directory
+     *   in which data can be shared with the greeters of other displays.
      *   Other keys are obtained from the PluginOptions option; see kdmrc
      *   for details.
      *   If the key is unknown, dflt is returned.
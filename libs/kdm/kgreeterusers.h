@@ -0,0 +1,192 @@
+/*
+
+User name store and completion for kdm greeter plugins
+
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+
+#ifndef KGREETERUSERS_H
+#define KGREETERUSERS_H
+
+#include <kcompletion.h>
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+#include <string.h>
+
+/**
+ * Sorted set of user names, meant to be filled incrementally while the
+ * users are still being enumerated.
+ *
+ * The names are kept in the local 8-bit encoding as one blob of
+ * NUL-terminated strings plus an offset index sorted bytewise. The
+ * index of the first name for each leading byte narrows down prefix
+ * searches to a binary search within one bucket.
+ */
+class KGreeterUserNames {
+  public:
+    KGreeterUserNames() { buckets.fill(0, 257); }
+
+    int count() const { return index.count(); }
+    bool isEmpty() const { return index.isEmpty(); }
+    const char *name(int i) const { return blob.constData() + index[i]; }
+    QString at(int i) const { return QString::fromLocal8Bit(name(i)); }
+
+    /**
+     * Add names; duplicates are dropped.
+     */
+    void insert(const QList<QByteArray> &names)
+    {
+        QVector<int> add;
+        add.reserve(names.count());
+        foreach (const QByteArray &n, names) {
+            if (n.isEmpty())
+                continue;
+            add.append(blob.size());
+            blob.append(n.constData(), n.size() + 1);
+        }
+        const char *b = blob.constData();
+        Less less(b);
+        std::sort(add.begin(), add.end(), less);
+        QVector<int> merged;
+        merged.reserve(index.count() + add.count());
+        int i = 0, j = 0;
+        while (i < index.count() || j < add.count()) {
+            int o;
+            if (j == add.count() ||
+                (i < index.count() && !less(add[j], index[i])))
+                o = index[i++];
+            else
+                o = add[j++];
+            if (merged.isEmpty() || strcmp(b + merged.last(), b + o))
+                merged.append(o);
+        }
+        index = merged;
+        for (int c = 0, k = 0; c < 256; c++) {
+            buckets[c] = k;
+            while (k < index.count() && (unsigned char)b[index[k]] == c)
+                k++;
+        }
+        buckets[256] = index.count();
+    }
+
+    void insert(const QStringList &names)
+    {
+        QList<QByteArray> add;
+        add.reserve(names.count());
+        foreach (const QString &n, names)
+            add.append(n.toLocal8Bit());
+        insert(add);
+    }
+
+    /**
+     * Find the names starting with @p prefix.
+     * @return the index of the first match; @p end receives the index
+     *  past the last one.
+     */
+    int range(const QByteArray &prefix, int *end) const
+    {
+        if (prefix.isEmpty()) {
+            *end = count();
+            return 0;
+        }
+        const char *b = blob.constData();
+        int c = (unsigned char)prefix[0];
+        QVector<int>::const_iterator first = index.constBegin() + buckets[c];
+        QVector<int>::const_iterator last = index.constBegin() + buckets[c + 1];
+        first = std::lower_bound(first, last, prefix, PrefixLess(b));
+        last = std::upper_bound(first, last, prefix, PrefixLess(b));
+        *end = last - index.constBegin();
+        return first - index.constBegin();
+    }
+
+    QStringList toStringList() const
+    {
+        QStringList ret;
+        ret.reserve(count());
+        for (int i = 0; i < count(); i++)
+            ret.append(at(i));
+        return ret;
+    }
+
+  private:
+    struct Less {
+        const char *b;
+        Less(const char *_b) : b(_b) {}
+        bool operator()(int x, int y) const { return strcmp(b + x, b + y) < 0; }
+    };
+    // compares only the first prefix.size() bytes of the names
+    struct PrefixLess {
+        const char *b;
+        PrefixLess(const char *_b) : b(_b) {}
+        bool operator()(int x, const QByteArray &p) const
+            { return strncmp(b + x, p.constData(), p.size()) < 0; }
+        bool operator()(const QByteArray &p, int x) const
+            { return strncmp(p.constData(), b + x, p.size()) < 0; }
+    };
+
+    QByteArray blob;
+    QVector<int> index;
+    QVector<int> buckets;
+};
+
+/**
+ * Completion object answering from a KGreeterUserNames store directly,
+ * so it follows the store while it grows and never copies the list.
+ * setFilter() restricts the completions to the names starting with a
+ * prefix (which is cut off) and not containing a given character.
+ */
+class KGreeterUserCompletion : public KCompletion {
+  public:
+    KGreeterUserCompletion(const KGreeterUserNames *_users)
+        : users(_users) {}
+
+    void setFilter(const QString &_prefix, QChar _exclude = QChar())
+    {
+        prefix = _prefix.toLocal8Bit();
+        exclude = _exclude.isNull() ? QByteArray() : QString(_exclude).toLocal8Bit();
+    }
+
+    virtual QString makeCompletion(const QString &string)
+    {
+        QString ret;
+        if (completionMode() == CompletionNone || string.isEmpty())
+            return ret;
+        int end, i = users->range(prefix + string.toLocal8Bit(), &end);
+        for (; i < end; i++) {
+            const char *n = users->name(i) + prefix.size();
+            if (exclude.isEmpty() || !strstr(n, exclude.constData())) {
+                ret = QString::fromLocal8Bit(n);
+                break;
+            }
+        }
+        emit match(ret);
+        return ret;
+    }
+
+  private:
+    const KGreeterUserNames *users;
+    QByteArray prefix, exclude;
+};
+
+#endif /* KGREETERUSERS_H */